@@ -0,0 +1,83 @@
+// string literal rendering throughput on large text columns:
+// single pass escaping in the renderer vs escaping every value beforehand.
+
+#include "stdafx.h"
+#include "SqlGen.h"
+#include <chrono>
+#include <stdio.h>
+
+using namespace sqlgen;
+
+struct Docs : Table
+{
+    Field id;
+    Field body;
+
+    Docs()
+        : Table("Docs")
+        , id    (this, SqlInt   , "id")
+        , body  (this, SqlString, "body")
+    {}
+};
+
+static Docs docs;
+static volatile size_t sink;
+
+// what callers had to do before the renderer escaped by itself.
+static string preEscape( const string& s )
+{
+    string r;
+    for(size_t i=0; i<s.size(); i++){
+        char c=s[i];
+        if (c=='\'' || c=='\\') r+='\\';
+        r+=c;
+    }
+    return r;
+}
+
+static string makeText( size_t len, size_t quoteEvery )
+{
+    string s;
+    s.reserve(len);
+    for(size_t i=0; i<len; i++){
+        s+= quoteEvery && i%quoteEvery==quoteEvery-1 ? '\'' : char('a'+i%26);
+    }
+    return s;
+}
+
+template<typename F>
+static void run( const char* name, const vector<string>& texts, int loops, F f )
+{
+    size_t bytes=0;
+    std::chrono::steady_clock::time_point t=std::chrono::steady_clock::now();
+    for(int l=0; l<loops; l++){
+        for(size_t i=0; i<texts.size(); i++){
+            bytes+=texts[i].size();
+            sink+=f(texts[i]).size();
+        }
+    }
+    double sec=std::chrono::duration<double>(std::chrono::steady_clock::now()-t).count();
+    printf("%-28s %8.1f MB/s\n", name, bytes/sec/1048576);
+}
+
+int main()
+{
+    const size_t sizes[]={64, 4096, 1<<20};
+    const size_t quotes[]={0, 1000, 16};
+    for(int s=0; s<3; s++){
+        for(int q=0; q<3; q++){
+            vector<string> texts(16, makeText(sizes[s], quotes[q]));
+            int loops=int((256<<20)/(sizes[s]*texts.size()));
+            printf("-- %zu byte text, a quote every %zu chars\n", sizes[s], quotes[q]);
+
+            run("render, escape in renderer", texts, loops, [](const string& t){
+                return Update().update(docs).set(docs.body=t).where(docs.id==1).toSql(DialectMysql);
+            });
+            run("pre-escape, then render", texts, loops, [](const string& t){
+                string e=preEscape(t);
+                return Update().update(docs).set(docs.body=e).where(docs.id==1).toSql(DialectMysql);
+            });
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+// insert throughput on a sqlite file: autocommit, group commit and one transaction.
+// needs the sqlite backend: SQLGEN_BACKEND=SQLITE.
+
+#include "stdafx.h"
+#include "tableDef.h"
+#include "SqlTransaction.h"
+#include <chrono>
+#include <stdio.h>
+
+using namespace sqlgen;
+using namespace dao;
+
+static Users users;
+static const char* dbFile = "bench_insert.db";
+
+static SqliteConnection* openDb( sqlite3*& db )
+{
+    remove(dbFile);
+    sqlite3_open(dbFile, &db);
+    SqliteConnection* c = new SqliteConnection(db);
+    execute(*c, "create table Users(name varchar(255), age int, addr varchar(255), score int, tag varchar(255))");
+    return c;
+}
+
+static Users::Row makeRow( int i, string& name )
+{
+    name = "user" + std::to_string(i);
+    Users::Row r;
+    r.name = name;
+    r.age = i%100;
+    r.addr = "some street";
+    r.score = i;
+    r.tag = "t";
+    return r;
+}
+
+template<typename F>
+static void run( const char* name, int rows, F f )
+{
+    sqlite3* db;
+    SqliteConnection* c = openDb(db);
+    std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+    f(*c, rows);
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now()-t).count();
+    printf("%-24s %6d rows %10.0f rows/s\n", name, rows, rows/sec);
+    delete c;
+    sqlite3_close(db);
+    remove(dbFile);
+}
+
+static void insertRows( SqlConnection& c, int rows, int groupSize )
+{
+    GroupCommit g(c, groupSize, 1000);
+    for(int i=0; i<rows; i++){
+        string name;
+        Users::Row r = makeRow(i, name);
+        g.add(Insert().insertInto(users).values(UnpackRowValues_Users(r, users)));
+    }
+}
+
+int main()
+{
+    run("autocommit", 500, [](SqlConnection& c, int rows){
+        for(int i=0; i<rows; i++){
+            string name;
+            Users::Row r = makeRow(i, name);
+            execute(c, Insert().insertInto(users).values(UnpackRowValues_Users(r, users)));
+        }
+    });
+    run("group commit, 10", 5000, [](SqlConnection& c, int rows){ insertRows(c, rows, 10); });
+    run("group commit, 100", 50000, [](SqlConnection& c, int rows){ insertRows(c, rows, 100); });
+    run("group commit, 1000", 200000, [](SqlConnection& c, int rows){ insertRows(c, rows, 1000); });
+    run("one transaction", 200000, [](SqlConnection& c, int rows){
+        Transaction tx(c);
+        for(int i=0; i<rows; i++){
+            string name;
+            Users::Row r = makeRow(i, name);
+            execute(c, Insert().insertInto(users).values(UnpackRowValues_Users(r, users)));
+        }
+        tx.commit();
+    });
+    return 0;
+}
@@ -0,0 +1,73 @@
+// statements rendered per second by 1..32 threads, with the per thread render 
+// buffers reused and with a fresh buffer allocated for every statement.
+
+#include "stdafx.h"
+#include "SqlGen.h"
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+
+using namespace sqlgen;
+
+struct Users : Table
+{
+    Field name;
+    Field age;
+    Field addr;
+    Field score;
+
+    Users()
+        : Table("Users")
+        , name  (this, SqlString, "name")
+        , age   (this, SqlInt   , "age")
+        , addr  (this, SqlString, "addr")
+        , score (this, SqlInt   , "score")
+    {}
+};
+
+static Users users;
+static volatile size_t sink;
+
+static size_t renderMix( int i )
+{
+    string name="user"+std::to_string(i);
+    size_t n=0;
+    n+=Select().select(users.name, users.age).from(users)
+        .where(users.age>i && users.name.like("a%")).orderBy(users.score, OrderDesc).limit(10).toSql().size();
+    n+=Update().update(users).set(users.score=i, users.addr="somewhere").where(users.name==name).toSql().size();
+    n+=Insert().insertInto(users).values(users.name=name, users.age=i, users.addr="x", users.score=i).toSql().size();
+    n+=Delete().from(users).where(users.age<i).toSql().size();
+    return n;
+}
+
+static double run( int nthreads, int perThread )
+{
+    std::chrono::steady_clock::time_point t=std::chrono::steady_clock::now();
+    vector<std::thread> threads;
+    for(int i=0; i<nthreads; i++){
+        threads.push_back(std::thread([perThread](){
+            size_t n=0;
+            for(int k=0; k<perThread; k++) n+=renderMix(k);
+            sink+=n;
+        }));
+    }
+    for(unsigned i=0; i<threads.size(); i++) threads[i].join();
+    double sec=std::chrono::duration<double>(std::chrono::steady_clock::now()-t).count();
+    return nthreads*perThread*4/sec;
+}
+
+int main()
+{
+    const int perThread=100000;
+    unsigned cores=std::thread::hardware_concurrency();
+    printf("%u hardware threads\n", cores);
+    printf("threads  reused stmt/s  per-call stmt/s\n");
+    for(int n=1; n<=32; n*=2){
+        setRenderBufferLimit(64*1024);
+        double reused=run(n, perThread);
+        setRenderBufferLimit(0);
+        double fresh=run(n, perThread);
+        printf("%7d  %13.0f  %15.0f\n", n, reused, fresh);
+    }
+    return 0;
+}
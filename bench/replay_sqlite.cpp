@@ -0,0 +1,94 @@
+// records a workload or replays a recording against a sqlite file.
+//   replay_sqlite record <log> <db>                     run a sample workload, recording it.
+//   replay_sqlite replay <log> <db> [speed] [threads]   speed 0 replays as fast as possible.
+// needs the sqlite backend: SQLGEN_BACKEND=SQLITE.
+
+#include "stdafx.h"
+#include "tableDef.h"
+#include "SqlRecorder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+using namespace sqlgen;
+using namespace dao;
+
+static Users users;
+
+static int record( const char* logFile, const char* dbFile )
+{
+    remove(dbFile);
+    sqlite3* db;
+    sqlite3_open(dbFile, &db);
+    SqliteConnection sqlite(db);
+    RecordingConnection c(sqlite, logFile);
+    if (!c.ok()) {
+        printf("can't write %s\n", logFile);
+        return 1;
+    }
+
+    execute(c, "create table Users(name varchar(255), age int, addr varchar(255), score int, tag varchar(255))");
+    for(int i=0; i<2000; i++){
+        string name = "user" + std::to_string(i);
+        Insert ins;
+        ins.insertInto(users).values(users.name=name, users.age=i%100, users.score=i);
+        execute(c, ins);
+
+        if (i%10==0) {
+            SqlResultReader* r = c.execute(Select().from(users).where(users.age==i%100).toSql(c.dialect()).c_str());
+            delete r;
+        }
+        if (i%50==0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    printf("recorded %d statements to %s\n", c.recorded, logFile);
+    sqlite3_close(db);
+    return 0;
+}
+
+static int replayLog( const char* logFile, const char* dbFile, double speed, int threads )
+{
+    std::vector<RecordedStatement> log;
+    if (!loadRecording(logFile, log)) {
+        printf("can't read %s\n", logFile);
+        return 1;
+    }
+
+    // the recording starts from an empty database, its leading DDL runs before the workers start.
+    remove(dbFile);
+    std::vector<sqlite3*> dbs(threads);
+    std::vector<SqliteConnection*> cons;
+    std::vector<SqlConnection*> workers;
+    for(int i=0; i<threads; i++){
+        sqlite3_open(dbFile, &dbs[i]);
+        sqlite3_busy_timeout(dbs[i], 5000);
+        cons.push_back(new SqliteConnection(dbs[i]));
+        workers.push_back(cons.back());
+    }
+
+    size_t ddl = 0;
+    while (ddl < log.size() && !strncmp(log[ddl].sql.c_str(), "create", 6)) ddl++;
+    replay(std::vector<RecordedStatement>(log.begin(), log.begin()+ddl), std::vector<SqlConnection*>(1, workers[0]), 0);
+    log.erase(log.begin(), log.begin()+ddl);
+
+    ReplayReport rep = replay(log, workers, speed);
+    printf("%s", rep.str().c_str());
+
+    for(int i=0; i<threads; i++){
+        delete cons[i];
+        sqlite3_close(dbs[i]);
+    }
+    return 0;
+}
+
+int main( int argc, char** argv )
+{
+    if (argc >= 4 && !strcmp(argv[1], "record")) return record(argv[2], argv[3]);
+    if (argc >= 4 && !strcmp(argv[1], "replay")) {
+        double speed = argc > 4 ? atof(argv[4]) : 1;
+        int threads = argc > 5 ? atoi(argv[5]) : 1;
+        return replayLog(argv[2], argv[3], speed, threads < 1 ? 1 : threads);
+    }
+    printf("usage: %s record <log> <db> | replay <log> <db> [speed] [threads]\n", argv[0]);
+    return 1;
+}
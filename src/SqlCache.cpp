@@ -0,0 +1,177 @@
+#include "stdafx.h"
+#include "SqlCache.h"
+#include <stdio.h>
+#include <string.h>
+
+
+namespace sqlgen{
+
+    static ResultCache* resultCache = 0;
+
+    void setResultCache( ResultCache* c )
+    {
+        resultCache = c;
+    }
+
+    ResultCache* getResultCache()
+    {
+        return resultCache;
+    }
+
+    const char* CachedResultReader::nextField()
+    {
+        int off = result->offsets[cur++];
+        return off < 0 ? 0 : result->data.c_str()+off;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    ResultCache::ResultCache( size_t maxBytes_, int ttlMs )
+        :maxBytes(maxBytes_),bytes(0),ttl(std::chrono::milliseconds(ttlMs)),hits(0),misses(0)
+    {
+    }
+
+    bool ResultCache::cacheable( const vector<const Table*>& tables ) const
+    {
+        if (tables.empty()) return false;
+        if (onlyTables.empty()) return true;
+        for(unsigned i=0; i<tables.size(); i++){
+            if (!onlyTables.count(tables[i]->m_tableName)) return false;
+        }
+        return true;
+    }
+
+    // the same sql on another database is another result.
+    static std::string keyOf( const SqlConnection& c, const std::string& sql )
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%p:", static_cast<const void*>(&c));
+        return buf + sql;
+    }
+
+    SqlResultReader* ResultCache::find( const SqlConnection& c, const std::string& sql )
+    {
+        std::string key = keyOf(c, sql);
+        std::lock_guard<std::mutex> g(lock);
+        std::unordered_map<std::string, Entry>::iterator it = entries.find(key);
+        if (it == entries.end()) {
+            misses++;
+            return 0;
+        }
+        if (it->second.expire <= Clock::now()) {
+            erase(it);
+            misses++;
+            return 0;
+        }
+        hits++;
+        lru.splice(lru.begin(), lru, it->second.lru);
+        return new CachedResultReader(it->second.result);
+    }
+
+    // generations only grow, their sum changes when one does.
+    unsigned ResultCache::generationOf( const vector<const Table*>& tables ) const
+    {
+        unsigned n = 0;
+        for(unsigned i=0; i<tables.size(); i++){
+            std::map<std::string, unsigned>::const_iterator it = generations.find(tables[i]->m_tableName);
+            if (it != generations.end()) n += it->second;
+        }
+        return n;
+    }
+
+    unsigned ResultCache::generation( const vector<const Table*>& tables )
+    {
+        std::lock_guard<std::mutex> g(lock);
+        return generationOf(tables);
+    }
+
+    void ResultCache::put( const SqlConnection& c, const std::string& sql, const std::shared_ptr<const StoredResult>& r, 
+        const vector<const Table*>& tables, unsigned gen )
+    {
+        std::string key = keyOf(c, sql);
+        size_t sz = key.size()*2 + r->data.size() + r->offsets.size()*sizeof(int) + sizeof(Entry);
+        if (sz > maxBytes) return;
+
+        std::lock_guard<std::mutex> g(lock);
+        // a write ran since the select started, its rows may be stale.
+        if (generationOf(tables) != gen) return;
+        std::unordered_map<std::string, Entry>::iterator it = entries.find(key);
+        if (it != entries.end()) erase(it);
+        while (bytes + sz > maxBytes && !lru.empty()) {
+            erase(entries.find(lru.back()));
+        }
+
+        lru.push_front(key);
+        Entry& e = entries[key];
+        e.result = r;
+        e.tables.clear();
+        e.expire = Clock::now() + ttl;
+        e.lru = lru.begin();
+        e.bytes = sz;
+        bytes += sz;
+        for(unsigned i=0; i<tables.size(); i++){
+            e.tables.push_back(tables[i]->m_tableName);
+            byTable[tables[i]->m_tableName].insert(key);
+        }
+    }
+
+    void ResultCache::erase( std::unordered_map<std::string, Entry>::iterator it )
+    {
+        Entry& e = it->second;
+        for(unsigned i=0; i<e.tables.size(); i++){
+            std::map<std::string, std::set<std::string>>::iterator t = byTable.find(e.tables[i]);
+            if (t == byTable.end()) continue;
+            t->second.erase(it->first);
+            if (t->second.empty()) byTable.erase(t);
+        }
+        lru.erase(e.lru);
+        bytes -= e.bytes;
+        entries.erase(it);
+    }
+
+    void ResultCache::invalidate( const std::string& table )
+    {
+        std::lock_guard<std::mutex> g(lock);
+        generations[table]++;
+        std::map<std::string, std::set<std::string>>::iterator it = byTable.find(table);
+        if (it == byTable.end()) return;
+
+        std::set<std::string> keys;
+        keys.swap(it->second);
+        for(std::set<std::string>::iterator k=keys.begin(); k!=keys.end(); ++k){
+            std::unordered_map<std::string, Entry>::iterator e = entries.find(*k);
+            if (e != entries.end()) erase(e);
+        }
+    }
+
+    void ResultCache::clear()
+    {
+        std::lock_guard<std::mutex> g(lock);
+        entries.clear();
+        lru.clear();
+        byTable.clear();
+        bytes = 0;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    SqlResultReader* executeSelect( SqlConnection& c, const std::string& sql, const Select& s )
+    {
+        ResultCache* rc = getResultCache();
+        if (!rc || c.transactionDepth()) return c.execute(sql.c_str());
+
+        vector<const Table*> tables;
+        s.getTables(tables);
+        if (!rc->cacheable(tables)) return c.execute(sql.c_str());
+
+        if (SqlResultReader* r = rc->find(c, sql)) return r;
+
+        unsigned gen = rc->generation(tables);
+        SqlResultReader* r = c.execute(sql.c_str());
+        if (!r) return 0;
+        std::shared_ptr<const StoredResult> stored(storeResult(r));
+        rc->put(c, sql, stored, tables, gen);
+        return new CachedResultReader(stored);
+    }
+
+}
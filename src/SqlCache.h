@@ -0,0 +1,72 @@
+#pragma once
+#include <map>
+#include <set>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include "SqlUtils.h"
+
+namespace sqlgen
+{
+    // client side cache of select results keyed by the connection and the rendered sql.
+    // entries expire after ttl and are dropped when an Insert/Update/Delete on 
+    // one of their tables is run through execute(). writes done with raw sql 
+    // strings or by other processes are only caught by the ttl. selects run inside
+    // a transaction are not cached, their rows could be rolled back, and the tables it
+    // wrote are invalidated again when it commits.
+    struct ResultCache
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        struct Entry
+        {
+            std::shared_ptr<const StoredResult>     result;
+            std::vector<string>                     tables;
+            Clock::time_point                       expire;
+            std::list<std::string>::iterator        lru;
+            size_t                                  bytes;
+        };
+
+        size_t                                          maxBytes, bytes;
+        Clock::duration                                 ttl;
+        std::unordered_map<std::string, Entry>          entries;
+        std::list<std::string>                          lru;        // most recently used first.
+        std::map<std::string, std::set<std::string>>    byTable;    // tables by name: aliases and other
+        std::set<std::string>                           onlyTables; // instances of a table are the same.
+        std::map<std::string, unsigned>                 generations;// invalidations by table.
+        std::mutex                                      lock;
+        int                                             hits, misses;
+
+        ResultCache(size_t maxBytes_, int ttlMs);
+        // only cache selects reading these tables, all tables when never called.
+        void    cacheOnly(const Table& t){ onlyTables.insert(t.m_tableName); }
+        bool    cacheable(const vector<const Table*>& tables)const;
+        // a reader over the cached result or null.
+        SqlResultReader* find(const SqlConnection& c, const std::string& sql);
+        // read before running the select and given to put(): a result read while one of its 
+        // tables was invalidated is dropped.
+        unsigned    generation(const vector<const Table*>& tables);
+        void    put(const SqlConnection& c, const std::string& sql, const std::shared_ptr<const StoredResult>& r, 
+                    const vector<const Table*>& tables, unsigned gen);
+        void    invalidate(const Table& t){ invalidate(t.m_tableName); }
+        void    invalidate(const std::string& table);
+        void    clear();
+
+    private:
+        unsigned    generationOf(const vector<const Table*>& tables)const;
+        void    erase(std::unordered_map<std::string, Entry>::iterator it);
+    };
+
+    // reads a result shared with the cache.
+    struct CachedResultReader : SqlResultReader
+    {
+        std::shared_ptr<const StoredResult> result;
+        unsigned                            cur;
+
+        explicit CachedResultReader(const std::shared_ptr<const StoredResult>& r):result(r),cur(0){ nrows=r->nrows; nfields=r->nfields; }
+        const char* nextField();
+        void        nextRow(){}
+        size_t      fieldLength(){ return result->lengthOf(cur-1); }
+    };
+}
@@ -0,0 +1,245 @@
+#include "stdafx.h"
+#include "SqlExplain.h"
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+
+
+namespace sqlgen{
+
+    static std::string field( SqlResultReader& r )
+    {
+        const char* f = r.nextField();
+        return f ? f : "";
+    }
+
+    static bool contains( const std::string& s, const char* sub )
+    {
+        return s.find(sub) != std::string::npos;
+    }
+
+    // columns: id, select_type, table, [partitions], type, possible_keys, key, key_len, ref, rows, [filtered], Extra
+    static void parseMysqlPlan( SqlResultReader& r, QueryPlan& p )
+    {
+        bool hasPartitions = r.nfields >= 12;
+        for(int row=0; row<r.nrows; row++){
+            PlanStep s;
+            for(int i=0; i<r.nfields; i++){
+                std::string f = field(r);
+                int col = hasPartitions || i < 3 ? i : i+1;
+                switch(col){
+                case 2: s.table = f; break;
+                case 4: s.access = f; break;
+                case 6: s.key = f; break;
+                case 9: s.rows = f.empty() ? -1 : atoll(f.c_str()); break;
+                }
+                if (i == r.nfields-1) s.detail = f;
+            }
+            s.fullScan = s.access == "ALL";
+            s.fileSort = contains(s.detail, "Using filesort");
+            s.tempTable = contains(s.detail, "Using temporary");
+            p.steps.push_back(s);
+        }
+    }
+
+    static std::string nextWord( const std::string& s, size_t& pos )
+    {
+        while (pos < s.size() && s[pos] == ' ') pos++;
+        size_t b = pos;
+        while (pos < s.size() && s[pos] != ' ') pos++;
+        return s.substr(b, pos-b);
+    }
+
+    // plan lines like: `SCAN Users`, `SEARCH Users USING INDEX idx_age (age=?)`, 
+    // `USE TEMP B-TREE FOR ORDER BY`, older versions say `SCAN TABLE Users`.
+    static void parseSqlitePlan( SqlResultReader& r, QueryPlan& p )
+    {
+        for(int row=0; row<r.nrows; row++){
+            PlanStep s;
+            for(int i=0; i<r.nfields; i++) s.detail = field(r);
+
+            size_t pos = 0;
+            s.access = nextWord(s.detail, pos);
+            if (s.access == "SCAN" || s.access == "SEARCH") {
+                s.table = nextWord(s.detail, pos);
+                if (s.table == "TABLE") s.table = nextWord(s.detail, pos);
+
+                size_t k = s.detail.find("INDEX ");
+                if (k != std::string::npos) {
+                    pos = k+6;
+                    s.key = nextWord(s.detail, pos);
+                }
+                else if (contains(s.detail, "PRIMARY KEY")) s.key = "PRIMARY";
+            }
+            s.fullScan = s.access == "SCAN" && s.key.empty() && s.table != "CONSTANT";
+            s.fileSort = contains(s.detail, "TEMP B-TREE FOR ORDER BY");
+            s.tempTable = contains(s.detail, "TEMP B-TREE FOR GROUP BY") || contains(s.detail, "TEMP B-TREE FOR DISTINCT");
+            p.steps.push_back(s);
+        }
+    }
+
+    // the word after `key ` in s, empty if none.
+    static std::string wordAfter( const std::string& s, const char* key )
+    {
+        size_t pos = s.find(key);
+        if (pos == std::string::npos) return "";
+        pos += strlen(key);
+        return nextWord(s, pos);
+    }
+
+    // one text column, a line per node and its properties:
+    // `Sort  (cost=.. rows=10 ..)`, `  Sort Key: age`, `  ->  Seq Scan on users  (cost=..)`,
+    // `  ->  Index Scan using idx_age on users  (cost=..)`.
+    static void parsePostgresPlan( SqlResultReader& r, QueryPlan& p )
+    {
+        for(int row=0; row<r.nrows; row++){
+            std::string line;
+            for(int i=0; i<r.nfields; i++) line = field(r);
+            size_t cost = line.find("  (cost=");
+            if (cost == std::string::npos) continue;
+
+            PlanStep s;
+            s.detail = line;
+            size_t b = line.find_first_not_of(" ->");
+            s.access = line.substr(b, cost-b);
+            s.table = wordAfter(s.access, " on ");
+            s.key = wordAfter(s.access, " using ");
+            size_t k = s.access.find(" using ");
+            if (k == std::string::npos) k = s.access.find(" on ");
+            if (k != std::string::npos) s.access.resize(k);
+            // `Bitmap Index Scan on idx_age` names the index, its table is in the heap scan above.
+            if (s.access == "Bitmap Index Scan") s.key.swap(s.table);
+
+            std::string rows = wordAfter(line, " rows=");
+            s.rows = rows.empty() ? -1 : atoll(rows.c_str());
+            s.fullScan = s.access == "Seq Scan";
+            s.fileSort = s.access == "Sort" || s.access == "Incremental Sort";
+            s.tempTable = s.access == "HashAggregate" || s.access == "Materialize" || s.access == "Unique";
+            p.steps.push_back(s);
+        }
+    }
+
+    QueryPlan explain( SqlConnection& c, const std::string& sql )
+    {
+        QueryPlan p;
+        SqlDialect d = c.dialect();
+        p.sql = sql;
+        p.dialect = d;
+
+        std::string ss = (d == DialectSqlite ? "EXPLAIN QUERY PLAN " : "EXPLAIN ") + sql;
+        std::unique_ptr<SqlResultReader> r(c.execute(ss.c_str()));
+        if (!r) return p;
+
+        p.ok = true;
+        switch(d){
+        case DialectSqlite: parseSqlitePlan(*r, p); break;
+        case DialectPostgres: parsePostgresPlan(*r, p); break;
+        default: parseMysqlPlan(*r, p); break;
+        }
+
+        for(unsigned i=0; i<p.steps.size(); i++){
+            p.fullScan |= p.steps[i].fullScan;
+            p.fileSort |= p.steps[i].fileSort;
+            p.tempTable |= p.steps[i].tempTable;
+        }
+        return p;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    static bool isIdentChar( char c )
+    {
+        return isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    static void putParam( std::string& o )
+    {
+        // `?,?` -> `?`
+        if (o.size() >= 2 && o[o.size()-1] == ',' && o[o.size()-2] == '?') {
+            o.resize(o.size()-1);
+            return;
+        }
+        o += '?';
+    }
+
+    std::string queryShape( const std::string& sql, SqlDialect d )
+    {
+        std::string o;
+        o.reserve(sql.size());
+        for(size_t i=0; i<sql.size(); ){
+            char c = sql[i];
+            if (c == '\'') {
+                for(i++; i<sql.size(); i++){
+                    if (sql[i] == '\\' && d == DialectMysql) i++;
+                    else if (sql[i] == '\'') {
+                        if (i+1 < sql.size() && sql[i+1] == '\'') i++;
+                        else break;
+                    }
+                }
+                i++;
+                putParam(o);
+            }
+            else if ((isdigit(static_cast<unsigned char>(c)) || (c == '-' && i+1 < sql.size() && isdigit(static_cast<unsigned char>(sql[i+1]))))
+                && (o.empty() || (!isIdentChar(o[o.size()-1]) && o[o.size()-1] != ')'))) {
+                i++;
+                while (i < sql.size() && (isalnum(static_cast<unsigned char>(sql[i])) || sql[i] == '.')) i++;
+                putParam(o);
+            }
+            else if (c == ' ' && !o.empty() && o[o.size()-1] == ',') i++;
+            else o += sql[i++];
+        }
+        return o;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    void PlanReport::add( const QueryPlan& p )
+    {
+        std::string shape = queryShape(p.sql, p.dialect);
+        std::map<std::string, Shape>::iterator it = shapes.find(shape);
+        if (it == shapes.end()) {
+            Shape s = { p.sql, 0, 0, 0, 0, -1 };
+            it = shapes.insert(std::make_pair(shape, s)).first;
+        }
+        Shape& s = it->second;
+        s.count++;
+        s.fullScans += p.fullScan;
+        s.fileSorts += p.fileSort;
+        s.tempTables += p.tempTable;
+        for(unsigned i=0; i<p.steps.size(); i++){
+            s.maxRows = std::max(s.maxRows, p.steps[i].rows);
+        }
+    }
+
+    QueryPlan PlanReport::explain( SqlConnection& c, const std::string& sql )
+    {
+        QueryPlan p = sqlgen::explain(c, sql);
+        if (p.ok) add(p);
+        return p;
+    }
+
+    static bool flagged( const PlanReport::Shape& s )
+    {
+        return s.fullScans || s.fileSorts || s.tempTables;
+    }
+
+    std::string PlanReport::str() const
+    {
+        typedef std::map<std::string, Shape>::const_iterator It;
+        std::vector<It> sorted;
+        for(It it=shapes.begin(); it!=shapes.end(); ++it) sorted.push_back(it);
+        std::sort(sorted.begin(), sorted.end(), [](It a, It b){
+            if (flagged(a->second) != flagged(b->second)) return flagged(a->second);
+            return a->second.count > b->second.count;
+        });
+
+        std::string o = "count\tscan\tsort\ttemp\tmaxRows\tshape\n";
+        for(unsigned i=0; i<sorted.size(); i++){
+            const Shape& s = sorted[i]->second;
+            o += std::to_string(s.count) + "\t" + std::to_string(s.fullScans) + "\t" + std::to_string(s.fileSorts) 
+                + "\t" + std::to_string(s.tempTables) + "\t" + std::to_string(s.maxRows) + "\t" + sorted[i]->first + "\n";
+        }
+        return o;
+    }
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <map>
+#include "SqlUtils.h"
+
+namespace sqlgen
+{
+    // one line of `EXPLAIN`(mysql), `EXPLAIN QUERY PLAN`(sqlite) or one node of `EXPLAIN`(postgres).
+    struct PlanStep
+    {
+        std::string table;
+        std::string access;     // mysql `type`(ALL, index, range, ref...), sqlite SCAN/SEARCH/USE, 
+                                // postgres the node(Seq Scan, Index Scan, Sort...).
+        std::string key;        // index used, empty if none.
+        long long   rows;       // estimated rows examined, -1 if unknown(sqlite).
+        std::string detail;     // mysql `Extra`, sqlite and postgres the whole plan line.
+        bool        fullScan, fileSort, tempTable;
+
+        PlanStep():rows(-1),fullScan(false),fileSort(false),tempTable(false){}
+    };
+
+    struct QueryPlan
+    {
+        std::string             sql;
+        SqlDialect              dialect;
+        std::vector<PlanStep>   steps;
+        bool                    ok, fullScan, fileSort, tempTable;
+
+        QueryPlan():dialect(getDefaultDialect()),ok(false),fullScan(false),fileSort(false),tempTable(false){}
+    };
+
+    // the plan is read the way the connection's dialect writes it.
+    QueryPlan   explain(SqlConnection& c, const std::string& sql);
+    inline QueryPlan explain(const std::string& sql){ return explain(*getConnection(), sql); }
+
+    // builders are rendered in the connection's dialect.
+    inline QueryPlan explain(SqlConnection& c, const Select& s){ return explain(c, s.toSql(c.dialect())); }
+    inline QueryPlan explain(SqlConnection& c, const Update& s){ return explain(c, s.toSql(c.dialect())); }
+    inline QueryPlan explain(SqlConnection& c, const Delete& s){ return explain(c, s.toSql(c.dialect())); }
+    inline QueryPlan explain(const Select& s){ return explain(*getConnection(), s); }
+    inline QueryPlan explain(const Update& s){ return explain(*getConnection(), s); }
+    inline QueryPlan explain(const Delete& s){ return explain(*getConnection(), s); }
+
+    // the sql with its literals replaced by `?` and literal lists collapsed to one `?`,
+    // so statements only differing by values have the same shape. backslashes escape in mysql strings only.
+    std::string queryShape(const std::string& sql, SqlDialect d=getDefaultDialect());
+
+    // explain results aggregated by query shape, to find the statements worth an index.
+    struct PlanReport
+    {
+        struct Shape
+        {
+            std::string example;
+            int         count, fullScans, fileSorts, tempTables;
+            long long   maxRows;
+        };
+        std::map<std::string, Shape> shapes;
+
+        void        add(const QueryPlan& p);
+        QueryPlan   explain(SqlConnection& c, const std::string& sql);
+        QueryPlan   explain(SqlConnection& c, const Select& s){ return explain(c, s.toSql(c.dialect())); }
+        // flagged shapes first, then by count.
+        std::string str()const;
+    };
+}
@@ -1,7 +1,21 @@
 #include "stdafx.h"
 #include "SqlGen.h"
 #include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
 #include <memory>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SQLGEN_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
 //#define STD_STREAM
 
@@ -9,49 +23,278 @@
 #include <sstream>
 #endif
 
-#ifdef _DEBUG
+// msvc debug builds define _DEBUG, others only leave NDEBUG undefined.
+#if defined(_DEBUG) || (!defined(_MSC_VER) && !defined(NDEBUG))
 #define DEBUG 1
 #else
 #define DEBUG 0
 #endif
 
+#if DEBUG && !defined(_MSC_VER)
+#include <signal.h>
+#endif
+
 
 namespace sqlgen 
 {
 #ifdef STD_STREAM
     using std::stringstream;
 #else
+    static size_t renderBufferLimit = 64*1024;
+
+    // render buffers are kept per thread and reused, so rendering a statement costs 
+    // no allocation but the returned string. buffers grown past the limit are dropped.
+    struct BufferPool
+    {
+        vector<string> free;
+
+        string acquire()
+        {
+            string s;
+            if (free.empty()) s.reserve(1024);
+            else {
+                s.swap(free.back());
+                free.pop_back();
+            }
+            return s;
+        }
+
+        void release(string& s)
+        {
+            if (s.capacity() > renderBufferLimit) return;
+            s.clear();
+            free.push_back(string());
+            free.back().swap(s);
+        }
+    };
+
+    static thread_local BufferPool bufferPool;
+
     struct stringstream
     {
         char temp[128];
         string buf;
-        stringstream() { buf.reserve(1024);}
-        stringstream& operator<<(int t)             { sprintf_s(temp, "%d", t); buf+=temp; return *this;}
+        stringstream():buf(bufferPool.acquire()) {}
+        ~stringstream() { bufferPool.release(buf); }
+        template<typename T, typename U>
+        stringstream& writeInt(T t)
+        {
+            char* end=temp+sizeof(temp);
+            char* p=end;
+            U v= t<0 ? U(0)-U(t) : U(t);
+            do { *--p=char('0'+v%10); v/=10; } while(v);
+            if (t<0) *--p='-';
+            buf.append(p, end-p); 
+            return *this;
+        }
+        stringstream& operator<<(int t)             { return writeInt<int, unsigned>(t); }
+        stringstream& operator<<(long long t)       { return writeInt<long long, unsigned long long>(t); }
         stringstream& operator<<(const char* t)     { buf+=t; return *this;}
         stringstream& operator<<(const string& t)   { buf+=t; return *this;}
-        stringstream& operator<<(const float t)     { sprintf_s(temp, "%f", t); buf+=temp; return *this;}
-        string str() { return std::move(buf); }
+        stringstream& operator<<(const float t)     { snprintf(temp, sizeof(temp), "%f", t); buf+=temp; return *this;}
+        stringstream& write(const char* t, size_t n){ buf.append(t, n); return *this;}
+        size_t size()const                          { return buf.size(); }
+        void repeat(size_t begin, size_t end)       { buf.append(buf, begin, end-begin); }
+        void reserve(size_t n)                      { if (buf.capacity() < buf.size()+n) buf.reserve(buf.size()+n); }
+        // the buffer goes back to the pool, unless it's too big to be kept anyway.
+        string str() { return buf.capacity() > renderBufferLimit ? std::move(buf) : buf; }
     };
 #endif
 
+    // everything differing between dialects, rendering reads it instead of testing the dialect.
+    struct DialectSyntax
+    {
+        const char* identQuote;
+        const char* escapes[3];     // replacements of quote, backslash and NUL in strings.
+        int         escapeLens[3];
+        const char* limitAll;       // the LIMIT needed before a lone OFFSET, null if not needed.
+        bool        numberedParams; // `$1` instead of `?`.
+        bool        conflictTarget; // upsert names the unique key: ON CONFLICT(key).
+        const char* upsert;
+        const char* insertedBegin;
+        const char* insertedEnd;
+        const char* bools[2];
+        const char* blobBegin;
+        const char* blobEnd;
+    };
+
+    static const DialectSyntax dialects[]={
+        // mysql, `''` is a quote with or without NO_BACKSLASH_ESCAPES.
+        { "`",  {"''", "\\\\", "\\0"},            {2, 2, 2},  "18446744073709551615", false, false, 
+          " ON DUPLICATE KEY UPDATE ", "VALUES(", ")", {"FALSE", "TRUE"}, "X'", "'" },
+        // sqlite
+        { "\"", {"''", "\\", "'||char(0)||'"},   {2, 1, 13}, "-1", false, true, 
+          " DO UPDATE SET ", "excluded.", "", {"0", "1"}, "X'", "'" },
+        // postgres
+        { "\"", {"''", "\\", "'||chr(0)||'"},    {2, 1, 12}, 0, true, true, 
+          " DO UPDATE SET ", "EXCLUDED.", "", {"FALSE", "TRUE"}, "'\\x", "'::bytea" },
+    };
+
+    static bool quoteIdentifiers = false;
+    static bool simplifyExpressions = false;
+
     struct GenContext
     {
         bool useFullFieldName;
         bool useBraces;
+        bool quoteIdent;
+        bool simplify;
+        int numParams;
+        RenderCache* cache;         // of the statement being rendered, records its nested selects.
+        int clause;                 // of that statement, being rendered.
+        const InList* chunk;        // renders keys [chunkBegin, chunkEnd) only, see Select::toSqlChunks.
+        size_t chunkBegin, chunkEnd;
+        const DialectSyntax& syntax;
+        vector<const Table*> ctes;  // tables declared by the `WITH` being rendered.
         stringstream s;
+#ifndef STD_STREAM
+        struct Rendered { const Select* sel; size_t begin, end; };
+        vector<Rendered> rendered;  // subqueries already in the output, repeats are copied.
+#endif
 
-        GenContext()
+        explicit GenContext(SqlDialect d)
             :useFullFieldName(false)
             ,useBraces(false)
+            ,quoteIdent(quoteIdentifiers)
+            ,simplify(simplifyExpressions)
+            ,numParams(0)
+            ,cache(0)
+            ,clause(0)
+            ,chunk(0)
+            ,chunkBegin(0)
+            ,chunkEnd(0)
+            ,syntax(dialects[d])
         {}
 
+        void subSelect(const Select& sel)
+        {
+            if (cache) {
+                RenderCache::Nested n={&sel.m_cache, sel.m_cache.version, clause};
+                cache->nested.push_back(n);
+            }
+#ifndef STD_STREAM
+            // numbered params must be renumbered, can't copy those.
+            if (!syntax.numberedParams) {
+                for(unsigned i=0; i<rendered.size(); i++){
+                    if (rendered[i].sel==&sel) { s.repeat(rendered[i].begin, rendered[i].end); return; }
+                }
+                Rendered r={&sel, s.size(), 0};
+                sel.render(*this);
+                r.end=s.size();
+                rendered.push_back(r);
+                return;
+            }
+#endif
+            sel.render(*this);
+        }
+
+        GenContext& ident(const string& name)
+        {
+            if (quoteIdent) s << syntax.identQuote << name << syntax.identQuote;
+            else s << name;
+            return *this;
+        }
+
         GenContext& operator<<(int t)           { s<<t; return *this;}
         GenContext& operator<<(const char* t)   { s<<t; return *this;}
         GenContext& operator<<(const string& t) { s<<t; return *this;}
+        GenContext& operator<<(long long t)     { s<<t; return *this;}
         GenContext& operator<<(float t)         { s<<t; return *this;}
+        GenContext& operator<<(double t);
+        GenContext& write(const char* t, size_t n){ s.write(t, n); return *this;}
+#ifdef STD_STREAM
+        void reserve(size_t){}
+        size_t size(){ return static_cast<size_t>(s.tellp()); }
+#else
+        void reserve(size_t n){ s.reserve(n); }
+        size_t size(){ return s.size(); }
+#endif
         string str(){return s.str();}
     };
 
+    static unsigned renderKey( SqlDialect d )
+    {
+        return d | quoteIdentifiers<<4 | simplifyExpressions<<5;
+    }
+
+    static void markClause( GenContext& o, RenderCache* c, int clause )
+    {
+        // a clause renders the same whether the ones before it were rendered or copied.
+        o.useBraces=false;
+        if (!c) return;
+        c->begin[clause]=o.size();
+        c->params[clause]=o.numParams;
+        o.clause=clause;
+    }
+
+    RenderCache& RenderCache::operator=( const RenderCache& c )
+    {
+        sql=c.sql;
+        std::copy(c.begin, c.begin+MaxClauses, begin);
+        std::copy(c.params, c.params+MaxClauses, params);
+        dirty=c.dirty;
+        key=c.key;
+        version=c.version;
+        nested=c.nested;
+        enabled=c.enabled;
+        return *this;
+    }
+
+    // renders a statement whose f(o, first, cache) renders its clauses from `first` on, the ones
+    // before the first changed one are copied from the cache. statements not cached, or being
+    // rendered by another thread, are rendered the plain way.
+    template<typename Func>
+    static string renderCached( RenderCache& c, SqlDialect d, Func f )
+    {
+        GenContext o(d);
+        if (!c.enabled || c.busy.exchange(true, std::memory_order_acquire)) {
+            f(o, 0, static_cast<RenderCache*>(0));
+            return o.str();
+        }
+
+        unsigned key=renderKey(d);
+        if (c.key!=key) {
+            c.key=key;
+            c.touch();
+        }
+        for(unsigned i=0; i<c.nested.size(); i++){
+            if (c.nested[i].cache->version!=c.nested[i].version) c.dirty |= 1u<<c.nested[i].clause;
+        }
+        if (!c.dirty) {
+            string sql=c.sql;
+            c.busy.store(false, std::memory_order_release);
+            return sql;
+        }
+
+        int first=0;
+        while (!(c.dirty>>first & 1)) first++;
+        if (first) {
+            o.write(c.sql.data(), c.begin[first]);
+            o.numParams=c.params[first];
+        }
+        // the nested selects of the clauses rendered again are recorded again.
+        size_t kept=0;
+        for(unsigned i=0; i<c.nested.size(); i++){
+            if (c.nested[i].clause<first) c.nested[kept++]=c.nested[i];
+        }
+        c.nested.resize(kept);
+        o.cache=&c;
+
+        // the clauses kept get marked where the rendering resumed, not where they begin.
+        size_t begin[RenderCache::MaxClauses];
+        int params[RenderCache::MaxClauses];
+        std::copy(c.begin, c.begin+first, begin);
+        std::copy(c.params, c.params+first, params);
+        f(o, first, &c);
+        std::copy(begin, begin+first, c.begin);
+        std::copy(params, params+first, c.params);
+        c.sql=o.str();
+        c.dirty=0;
+        string sql=c.sql;
+        c.busy.store(false, std::memory_order_release);
+        return sql;
+    }
+
     static LogAssert assertLogger = puts;
 
     void setAssertLogger( LogAssert l )
@@ -59,36 +302,85 @@ namespace sqlgen
         assertLogger = l;
     }
 
+    static SqlDialect defaultDialect = DialectMysql;
+
+    void setDefaultDialect( SqlDialect d )
+    {
+        defaultDialect = d;
+    }
+
+    SqlDialect getDefaultDialect()
+    {
+        return defaultDialect;
+    }
+
+    void setQuoteIdentifiers( bool v )
+    {
+        quoteIdentifiers = v;
+    }
+
+    void setSimplifyExpressions( bool v )
+    {
+        simplifyExpressions = v;
+    }
+
+    void setRenderBufferLimit( size_t bytes )
+    {
+#ifndef STD_STREAM
+        renderBufferLimit = bytes;
+#endif
+    }
+
 #if DEBUG
-#define sqlAssert(exp, msg, ...) _assert(exp, #exp, __FILE__, __LINE__, msg, __VA_ARGS__)
+#define sqlAssert(exp, msg, ...) _assert(exp, #exp, __FILE__, __LINE__, msg, ##__VA_ARGS__)
+
+    static void debugBreak()
+    {
+#ifdef _MSC_VER
+        __debugbreak();
+#else
+        raise(SIGTRAP);
+#endif
+    }
 
     void _assert( bool v, const char* exp, const char* f, int line, const char* msg, ... )
     {
         if (v) return;
 
-        char buf[255];
-        char* p=buf, *end=buf+sizeof(buf);
+        char buf[512];
+        size_t n=0;
         va_list va;
         va_start(va, msg);
-        p+=sprintf_s(p, end-p, "#======== Assert ========#\nMsg : ");
-        p+=vsprintf_s(p, end-p,  msg, va);
-        p+=sprintf_s(p, end-p, "\nExp : %s at %s(%d)\n", exp, f, line);
-        p+=sprintf_s(p, end-p, "#========================#\n");
+        n+=snprintf(buf, sizeof(buf), "#======== Assert ========#\nMsg : ");
+        if (n<sizeof(buf)) n+=vsnprintf(buf+n, sizeof(buf)-n, msg, va);
+        if (n<sizeof(buf)) n+=snprintf(buf+n, sizeof(buf)-n, "\nExp : %s at %s(%d)\n", exp, f, line);
+        if (n<sizeof(buf)) snprintf(buf+n, sizeof(buf)-n, "#========================#\n");
         va_end(va);
 
         if (assertLogger) assertLogger(buf);
-        _asm { int 3 };
+        debugBreak();
     }
 
-#else
-#define sqlAssert(...)
-#endif
-    
     static const char* primaryTypeStr( SqlPrimaryType t )
     {
-        const char* s[]={"NoType","Null", "String", "Int", "Bool", "Float", "VarType"};
+        const char* s[]={"NoType","Null", "String", "Int", "Bool", "Float", "Int64", "Double", "DateTime", "Blob"};
         return s[t];
     }
+
+    static bool isNumeric( SqlPrimaryType t )
+    {
+        return t==SqlInt || t==SqlInt64 || t==SqlFloat || t==SqlDouble;
+    }
+
+    // numbers mix freely, e.g. a BIGINT field against an int literal.
+    static bool compatibleTypes( SqlPrimaryType a, SqlPrimaryType b )
+    {
+        return a==b || (isNumeric(a) && isNumeric(b));
+    }
+
+#else
+#define sqlAssert(...)
+#endif
         
     SqlPrimaryType BinExp::getSqlType() const
     {
@@ -100,21 +392,45 @@ namespace sqlgen
     const char* BinExp::opCppTypeStr( OpType t )
     {
         const char* op[]={
-            "&&", "||", ">", "<", "==", ">=", "<=", "!=", "<like>"
+            "&&", "||", ">", "<", "==", ">=", "<=", "!=", "<like>",
             "=", "+", "-", "*", "/", "%",
         };
         return op[t];
     }
 
+    static const char* sqlOps[]={
+        " AND ", " OR ", " > ", " < ", "=", " >= ", " <= ", " <> ", " LIKE ", 
+        "=", "+", "-", "*", "/", "%",            
+    };
+
+    static void writeSimplified(GenContext& o, const Exp& e, int parentPrec, bool right);
+
+    static bool isNegative( const Exp& e )
+    {
+        if (e.getRtti()!=RttiLiteral) return false;
+        const Literal& l=static_cast<const Literal&>(e);
+        switch(l.type){
+        case SqlInt: return l.i<0;
+        case SqlInt64: return l.i64<0;
+        case SqlFloat: return l.f<0;
+        case SqlDouble: return l.d<0;
+        default: return false;
+        }
+    }
+
     void BinExp::toSql( GenContext& o ) const
     {
-        sqlAssert(l.getSqlType()==r.getSqlType(), "left operand type(%s) != right operand type(%s)",
+        sqlAssert(compatibleTypes(l.getSqlType(), r.getSqlType()), "left operand type(%s) != right operand type(%s)",
             primaryTypeStr(l.getSqlType()), primaryTypeStr(r.getSqlType()));
 
-        const char* op[]={
-            " AND ", " OR ", " > ", " < ", "=", " >= ", " <= ", " <> ", " LIKE ", 
-            "=", "+", "-", "*", "/", "%",            
-        };
+        if (o.simplify) {
+            // braces asked by the caller, e.g. the operand of `IN`.
+            writeSimplified(o, *this, o.useBraces ? 100 : 0, false);
+            o.useBraces=false;
+            return;
+        }
+
+        const char* const* op=sqlOps;
 
         if (opType==Like){
             sqlAssert(r.getSqlType()==SqlString, "`like` clause need a string, got: %s", primaryTypeStr(r.getSqlType()));
@@ -123,22 +439,583 @@ namespace sqlgen
         bool genBraces=o.useBraces;
         if (genBraces) o <<"(";
 
-        if (l.getRtti()==RttiBinExp || r.getRtti()==RttiBinExp) 
-            o.useBraces = true;
-        else
-            o.useBraces = false;
-        o << l << op[opType] << r;
+        // the left operand resets the flag.
+        bool braces= l.getRtti()==RttiBinExp || r.getRtti()==RttiBinExp;
+        o.useBraces = braces;
+        o << l << op[opType];
+        o.useBraces = braces;
+        // `a - -1` would start a comment.
+        if (opType==Sub && isNegative(r)) o << "(" << r << ")";
+        else o << r;
+        o.useBraces = false;
         
         if (genBraces) o << ")";
     }
 
+    //////////////////////////////////////////////////////////////////////////
+    // simplification, see setSimplifyExpressions().
+
+    // the value of a literal only subexpression, type is SqlNoType when it's not constant.
+    struct ConstValue
+    {
+        SqlPrimaryType  type;   // SqlInt64, SqlDouble or SqlBool.
+        long long       i;
+        double          d;
+        bool            b;
+        bool            single; // a float literal, printed like one.
+    };
+
+    static ConstValue constInt( long long v ){ ConstValue c={SqlInt64, v, 0, false, false}; return c; }
+    static ConstValue constDouble( double v ){ ConstValue c={SqlDouble, 0, v, false, false}; return c; }
+    static ConstValue constBool( bool v ){ ConstValue c={SqlBool, 0, 0, v, false}; return c; }
+    static ConstValue notConst(){ ConstValue c={SqlNoType, 0, 0, false, false}; return c; }
+
+    static bool addInt( long long a, long long b, long long& out )
+    {
+        if ((b>0 && a>LLONG_MAX-b) || (b<0 && a<LLONG_MIN-b)) return false;
+        out=a+b;
+        return true;
+    }
+
+    static bool subInt( long long a, long long b, long long& out )
+    {
+        return b!=LLONG_MIN && addInt(a, -b, out);
+    }
+
+    static bool isFalse( const ConstValue& c ){ return c.type==SqlBool && !c.b; }
+    static bool isTrue( const ConstValue& c ){ return c.type==SqlBool && c.b; }
+
+    static ConstValue evalConst( const Exp& e );
+
+    // a float literal is printed with fewer digits than it holds, the value is the one
+    // the server reads back.
+    static ConstValue constFloat( float v )
+    {
+        GenContext o(DialectMysql);
+        o << v;
+        ConstValue c={SqlDouble, 0, strtod(o.str().c_str(), 0), false, true};
+        return c;
+    }
+
+    // whether e renders a placeholder, subqueries included. numbered ones are counted.
+    static bool hasParam( const Exp& e )
+    {
+        if (e.getRtti()==RttiParam) return true;
+        if (e.getRtti()==RttiLiteral) return false;
+        GenContext o(DialectPostgres);
+        o.simplify=false;
+        o << e;
+        return o.numParams>0;
+    }
+
+    static ConstValue evalArith( BinExp::OpType op, const ConstValue& l, const ConstValue& r )
+    {
+        if (l.type==SqlInt64 && r.type==SqlInt64) {
+            long long v;
+            switch(op){
+            case BinExp::Add: if (addInt(l.i, r.i, v)) return constInt(v); break;
+            case BinExp::Sub: if (subInt(l.i, r.i, v)) return constInt(v); break;
+            case BinExp::Mul: 
+                if (fabs(double(l.i)*double(r.i)) < 9.2e18) return constInt(l.i*r.i); 
+                break;
+            case BinExp::Mod: if (r.i>0) return constInt(l.i%r.i); break;
+            // integer division differs between dialects, mysql gives a decimal.
+            default: break;
+            }
+            return notConst();
+        }
+        double a= l.type==SqlInt64 ? double(l.i) : l.d;
+        double b= r.type==SqlInt64 ? double(r.i) : r.d;
+        switch(op){
+        case BinExp::Add: return constDouble(a+b);
+        case BinExp::Sub: return constDouble(a-b);
+        case BinExp::Mul: return constDouble(a*b);
+        case BinExp::Div: if (b!=0) return constDouble(a/b); break;
+        default: break;
+        }
+        return notConst();
+    }
+
+    static ConstValue evalCompare( BinExp::OpType op, const ConstValue& l, const ConstValue& r )
+    {
+        int cmp;
+        if (l.type==SqlBool || r.type==SqlBool) {
+            if (l.type!=r.type) return notConst();
+            cmp= int(l.b)-int(r.b);
+        }
+        else if (l.type==SqlInt64 && r.type==SqlInt64) cmp= l.i<r.i ? -1 : l.i>r.i;
+        else {
+            double a= l.type==SqlInt64 ? double(l.i) : l.d;
+            double b= r.type==SqlInt64 ? double(r.i) : r.d;
+            cmp= a<b ? -1 : a>b;
+        }
+        switch(op){
+        case BinExp::LargerThan: return constBool(cmp>0);
+        case BinExp::LessThan: return constBool(cmp<0);
+        case BinExp::Equ: return constBool(cmp==0);
+        case BinExp::LargerEqu: return constBool(cmp>=0);
+        case BinExp::LessEqu: return constBool(cmp<=0);
+        case BinExp::NotEqu: return constBool(cmp!=0);
+        default: return notConst();
+        }
+    }
+
+    static ConstValue evalConst( const Exp& e )
+    {
+        if (e.getRtti()==RttiLiteral) {
+            const Literal& l=static_cast<const Literal&>(e);
+            switch(l.type){
+            case SqlInt: return constInt(l.i);
+            case SqlInt64: return constInt(l.i64);
+            case SqlFloat: return constFloat(l.f);
+            case SqlDouble: return constDouble(l.d);
+            case SqlBool: return constBool(l.b);
+            default: return notConst();
+            }
+        }
+        if (e.getRtti()!=RttiBinExp) return notConst();
+
+        const BinExp& b=static_cast<const BinExp&>(e);
+        ConstValue l=evalConst(b.l), r=evalConst(b.r);
+        switch(b.opType){
+        // `x AND false` is false and `x OR true` is true, even when x is NULL. unless x holds
+        // a param the caller still binds.
+        case BinExp::And:
+            if ((isFalse(l) && !hasParam(b.r)) || (isFalse(r) && !hasParam(b.l))) return constBool(false);
+            if (isTrue(l) && isTrue(r)) return constBool(true);
+            return notConst();
+        case BinExp::Or:
+            if ((isTrue(l) && !hasParam(b.r)) || (isTrue(r) && !hasParam(b.l))) return constBool(true);
+            if (isFalse(l) && isFalse(r)) return constBool(false);
+            return notConst();
+        case BinExp::Like: case BinExp::Assign:
+            return notConst();
+        default:
+            if (!l.type || !r.type) return notConst();
+            if (b.opType<=BinExp::LogicOpLast) return evalCompare(b.opType, l, r);
+            if (l.type==SqlBool || r.type==SqlBool) return notConst();
+            return evalArith(b.opType, l, r);
+        }
+    }
+
+    static void writeConst( GenContext& o, const ConstValue& c, bool wrapNegative )
+    {
+        bool neg= (c.type==SqlInt64 && c.i<0) || (c.type==SqlDouble && c.d<0);
+        // `a - -1` would start a comment.
+        if (neg && wrapNegative) o << "(";
+        switch(c.type){
+        case SqlInt64: o << c.i; break;
+        case SqlDouble: if (c.single) o << static_cast<float>(c.d); else o << c.d; break;
+        default: o << o.syntax.bools[c.b]; break;
+        }
+        if (neg && wrapNegative) o << ")";
+    }
+
+    // same tree: same nodes, or operators and literals of equal values over the same nodes.
+    // a tree holding params is never the same, each of them is bound.
+    static bool sameExp( const Exp& a, const Exp& b )
+    {
+        if (&a==&b) return !hasParam(a);
+        if (a.getRtti()!=b.getRtti()) return false;
+        if (a.getRtti()==RttiBinExp) {
+            const BinExp& x=static_cast<const BinExp&>(a);
+            const BinExp& y=static_cast<const BinExp&>(b);
+            return x.opType==y.opType && sameExp(x.l, y.l) && sameExp(x.r, y.r);
+        }
+        if (a.getRtti()==RttiLiteral) {
+            const Literal& x=static_cast<const Literal&>(a);
+            const Literal& y=static_cast<const Literal&>(b);
+            if (x.type!=y.type) return false;
+            switch(x.type){
+            case SqlString: case SqlBlob: {
+                size_t n= x.len==size_t(-1) ? strlen(x.l) : x.len;
+                size_t m= y.len==size_t(-1) ? strlen(y.l) : y.len;
+                return n==m && !memcmp(x.l, y.l, n);
+            }
+            case SqlDateTime: return !memcmp(&x.t, &y.t, sizeof(x.t));
+            default: {
+                ConstValue u=evalConst(x), v=evalConst(y);
+                return u.type==v.type && u.i==v.i && u.d==v.d && u.b==v.b && u.single==v.single;
+            }
+            }
+        }
+        return false;
+    }
+
+    static int precedence( BinExp::OpType t )
+    {
+        switch(t){
+        case BinExp::Assign: return 0;
+        case BinExp::Or: return 1;
+        case BinExp::And: return 2;
+        case BinExp::Add: case BinExp::Sub: return 4;
+        case BinExp::Mul: case BinExp::Div: case BinExp::Mod: return 5;
+        default: return 3; // comparisons and `LIKE`.
+        }
+    }
+
+    static BinExp::OpType mirror( BinExp::OpType t )
+    {
+        switch(t){
+        case BinExp::LargerThan: return BinExp::LessThan;
+        case BinExp::LessThan: return BinExp::LargerThan;
+        case BinExp::LargerEqu: return BinExp::LessEqu;
+        case BinExp::LessEqu: return BinExp::LargerEqu;
+        default: return t;
+        }
+    }
+
+    static void collectTerms( const Exp& e, BinExp::OpType op, vector<const Exp*>& out )
+    {
+        if (e.getRtti()==RttiBinExp && static_cast<const BinExp&>(e).opType==op) {
+            const BinExp& b=static_cast<const BinExp&>(e);
+            collectTerms(b.l, op, out);
+            collectTerms(b.r, op, out);
+            return;
+        }
+        ConstValue c=evalConst(e);
+        // true in an `AND` and false in an `OR` change nothing.
+        if (c.type==SqlBool && c.b==(op==BinExp::And)) return;
+        for(unsigned i=0; i<out.size(); i++){
+            if (sameExp(*out[i], e)) return;
+        }
+        out.push_back(&e);
+    }
+
+    // `x+c OP k` is `x OP k-c`, the column is left alone so an index on it can be used.
+    static bool writeSargable( GenContext& o, const BinExp& b )
+    {
+        const Exp* x=&b.l;
+        BinExp::OpType op=b.opType;
+        ConstValue k=evalConst(b.r);
+        if (k.type!=SqlInt64) {
+            k=evalConst(b.l);
+            x=&b.r;
+            op=mirror(op);
+        }
+        if (k.type!=SqlInt64 || x->getRtti()!=RttiBinExp) return false;
+
+        bool moved=false;
+        while (x->getRtti()==RttiBinExp) {
+            const BinExp& a=static_cast<const BinExp&>(*x);
+            if (a.opType!=BinExp::Add && a.opType!=BinExp::Sub) break;
+            ConstValue cl=evalConst(a.l), cr=evalConst(a.r);
+            long long v;
+            if (cr.type==SqlInt64 && (a.opType==BinExp::Add ? subInt(k.i, cr.i, v) : addInt(k.i, cr.i, v))) x=&a.l;
+            else if (cl.type==SqlInt64 && a.opType==BinExp::Add && subInt(k.i, cl.i, v)) x=&a.r;
+            else if (cl.type==SqlInt64 && a.opType==BinExp::Sub && subInt(cl.i, k.i, v)) { x=&a.r; op=mirror(op); }
+            else break;
+            k.i=v;
+            moved=true;
+        }
+        if (!moved) return false;
+
+        writeSimplified(o, *x, precedence(op), false);
+        o << sqlOps[op];
+        writeConst(o, k, true);
+        return true;
+    }
+
+    static void writeSimplified( GenContext& o, const Exp& e, int parentPrec, bool right )
+    {
+        if (e.getRtti()!=RttiBinExp) {
+            ConstValue c=evalConst(e);
+            if (c.type) writeConst(o, c, parentPrec>=precedence(BinExp::Add));
+            else o << e;
+            return;
+        }
+
+        const BinExp& b=static_cast<const BinExp&>(e);
+        ConstValue c=evalConst(b);
+        if (c.type) {
+            writeConst(o, c, parentPrec>=precedence(BinExp::Add));
+            return;
+        }
+
+        int prec=precedence(b.opType);
+        if (b.opType==BinExp::And || b.opType==BinExp::Or) {
+            vector<const Exp*> terms;
+            collectTerms(b, b.opType, terms);
+            if (terms.size()==1) {
+                writeSimplified(o, *terms[0], parentPrec, right);
+                return;
+            }
+            bool braces= prec<parentPrec;
+            if (braces) o << "(";
+            for(unsigned i=0; i<terms.size(); i++){
+                if (i) o << sqlOps[b.opType];
+                writeSimplified(o, *terms[i], prec, i!=0);
+            }
+            if (braces) o << ")";
+            return;
+        }
+
+        // comparisons don't chain and the right side of - / % binds first.
+        bool braces= prec<parentPrec || (prec==parentPrec && (right || prec==precedence(BinExp::Equ)));
+        if (braces) o << "(";
+        if (prec!=precedence(BinExp::Equ) || b.opType==BinExp::Like || !writeSargable(o, b)) {
+            writeSimplified(o, b.l, prec, false);
+            o << sqlOps[b.opType];
+            writeSimplified(o, b.r, prec ? prec : 100, true);
+        }
+        if (braces) o << ")";
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+#ifdef SQLGEN_SSE2
+    static inline int firstBit( int v )
+    {
+#ifdef _MSC_VER
+        unsigned long i;
+        _BitScanForward(&i, v);
+        return i;
+#else
+        return __builtin_ctz(v);
+#endif
+    }
+#endif
+
+    // the first char needing an escape in [p, end): quote, backslash or NUL.
+    static const char* findEscape( const char* p, const char* end )
+    {
+#ifdef SQLGEN_SSE2
+        const __m128i quote=_mm_set1_epi8('\''), slash=_mm_set1_epi8('\\'), zero=_mm_setzero_si128();
+        for(; end-p >= 16; p+=16){
+            __m128i v=_mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i m=_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)), _mm_cmpeq_epi8(v, zero));
+            if (int bits=_mm_movemask_epi8(m)) return p+firstBit(bits);
+        }
+#endif
+        for(; p<end; p++){
+            if (*p=='\'' || *p=='\\' || !*p) return p;
+        }
+        return end;
+    }
+
+    // quote and escape a string in one pass, runs without special chars are copied as is.
+    static void writeString( GenContext& o, const char* p, size_t n )
+    {
+        const char* end=p+n;
+        o.reserve(n+2);
+        o.write("\'", 1);
+        for(;;){
+            const char* q=findEscape(p, end);
+            o.write(p, q-p);
+            if (q==end) break;
+
+            int e= *q=='\'' ? 0 : *q=='\\' ? 1 : 2;
+            o.write(o.syntax.escapes[e], o.syntax.escapeLens[e]);
+            p=q+1;
+        }
+        o.write("\'", 1);
+    }
+
+    // shortest of %.15g and %.17g that reads back the same, integral values skip printf.
+    // the value always reads as a real: `age/2` would be an integer division, `age/2.0` isn't.
+    static size_t formatDouble( char (&buf)[32], double d )
+    {
+        if (d > -9.2e18 && d < 9.2e18 && d==static_cast<double>(static_cast<long long>(d))) {
+            long long v=static_cast<long long>(d);
+            char* end=buf+sizeof(buf);
+            char* p=end-2;
+            memcpy(p, ".0", 2);
+            unsigned long long u= v<0 ? 0ull-static_cast<unsigned long long>(v) : static_cast<unsigned long long>(v);
+            do { *--p=char('0'+u%10); u/=10; } while(u);
+            if (v<0) *--p='-';
+            memmove(buf, p, end-p);
+            return end-p;
+        }
+        int len=snprintf(buf, sizeof(buf), "%.15g", d);
+        if (strtod(buf, 0)!=d) len=snprintf(buf, sizeof(buf), "%.17g", d);
+        if (!strpbrk(buf, ".e")) {
+            memcpy(buf+len, ".0", 3);
+            len+=2;
+        }
+        return len;
+    }
+
+    GenContext& GenContext::operator<<( double t )
+    {
+        // there's no literal for these.
+        if (t!=t || t-t!=0) return *this<<"NULL";
+        char buf[32];
+        return write(buf, formatDouble(buf, t));
+    }
+
+    static char* writeDigits( char* p, int v, int n )
+    {
+        for(int k=n-1; k>=0; k--, v/=10) p[k]=char('0'+v%10);
+        return p+n;
+    }
+
+    static void writeDateTime( GenContext& o, const DateTime& t )
+    {
+        char buf[21];
+        char* p=buf;
+        *p++='\'';
+        p=writeDigits(p, t.year, 4); *p++='-';
+        p=writeDigits(p, t.month, 2); *p++='-';
+        p=writeDigits(p, t.day, 2); *p++=' ';
+        p=writeDigits(p, t.hour, 2); *p++=':';
+        p=writeDigits(p, t.minute, 2); *p++=':';
+        p=writeDigits(p, t.second, 2);
+        *p++='\'';
+        o.write(buf, p-buf);
+    }
+
+    static void writeBlob( GenContext& o, const char* p, size_t n )
+    {
+        static const char hex[]="0123456789ABCDEF";
+        char buf[256];
+        o.reserve(n*2+16);
+        o<<o.syntax.blobBegin;
+        while (n) {
+            size_t k= n < sizeof(buf)/2 ? n : sizeof(buf)/2;
+            for(size_t j=0; j<k; j++){
+                unsigned char c=static_cast<unsigned char>(p[j]);
+                buf[j*2]=hex[c>>4];
+                buf[j*2+1]=hex[c&15];
+            }
+            o.write(buf, k*2);
+            p+=k;
+            n-=k;
+        }
+        o<<o.syntax.blobEnd;
+    }
+
     void Literal::toSql( GenContext& o ) const
     {
         switch(type){
-        case SqlString: o << "\'"<<l<<"\'"; break;
+        case SqlString: writeString(o, l, len==size_t(-1) ? strlen(l) : len); break;
         case SqlInt: o<<i; break;
+        case SqlInt64: o<<i64; break;
+        case SqlBool: o<<o.syntax.bools[b]; break;
         case SqlFloat: o<<f; break;
+        case SqlDouble: o<<d; break;
+        case SqlDateTime: writeDateTime(o, t); break;
+        case SqlBlob: writeBlob(o, l, len); break;
         case SqlNull: o<<"NULL"; break;
+        default: sqlAssert(false, "literal without a value"); break;
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    // days since 1970-01-01 of a civil date and back, proleptic gregorian.
+    static long long daysFromCivil( long long y, unsigned m, unsigned d )
+    {
+        y -= m<=2;
+        long long era = (y>=0 ? y : y-399) / 400;
+        unsigned yoe = static_cast<unsigned>(y - era*400);
+        unsigned doy = (153*(m>2 ? m-3 : m+9) + 2)/5 + d-1;
+        unsigned doe = yoe*365 + yoe/4 - yoe/100 + doy;
+        return era*146097 + static_cast<long long>(doe) - 719468;
+    }
+
+    DateTime DateTime::fromTime( long long unixSeconds )
+    {
+        long long days = unixSeconds/86400, secs = unixSeconds%86400;
+        if (secs<0) { secs+=86400; days--; }
+
+        long long z = days + 719468;
+        long long era = (z>=0 ? z : z-146096) / 146097;
+        unsigned doe = static_cast<unsigned>(z - era*146097);
+        unsigned yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+        unsigned doy = doe - (365*yoe + yoe/4 - yoe/100);
+        unsigned mp = (5*doy + 2)/153;
+        unsigned m = mp<10 ? mp+3 : mp-9;
+
+        DateTime t;
+        t.year = static_cast<int>(yoe + era*400 + (m<=2));
+        t.month = static_cast<int>(m);
+        t.day = static_cast<int>(doy - (153*mp+2)/5 + 1);
+        t.hour = static_cast<int>(secs/3600);
+        t.minute = static_cast<int>(secs/60%60);
+        t.second = static_cast<int>(secs%60);
+        return t;
+    }
+
+    long long DateTime::toTime() const
+    {
+        return daysFromCivil(year, month, day)*86400 + hour*3600 + minute*60 + second;
+    }
+
+    void Alias::toSql( GenContext& o ) const
+    {
+        o.ident(name);
+    }
+
+    void InList::toSql( GenContext& o ) const
+    {
+        if (sel) {
+            o.useBraces=true;
+            o << exp;
+            o.useBraces=false;
+            o << (negate ? " NOT IN (" : " IN (");
+            o.subSelect(*sel);
+            o << ")";
+            return;
+        }
+
+        sqlAssert(compatibleTypes(exp.getSqlType(), keyType), "`in` clause key type(%s) != operand type(%s)",
+            primaryTypeStr(keyType), primaryTypeStr(exp.getSqlType()));
+
+        size_t begin= o.chunk==this ? o.chunkBegin : 0;
+        size_t end= o.chunk==this ? o.chunkEnd : count;
+        // `IN ()` is not valid sql.
+        if (begin==end) { o << (negate ? "1=1" : "1=0"); return; }
+
+        o.useBraces=true;
+        o << exp;
+        o.useBraces=false;
+        o << (negate ? " NOT IN (" : " IN (");
+        for(size_t i=begin; i<end; i++){
+            if (i!=begin) o << ",";
+            if (ints) o << ints[i];
+            else if (int64s) o << int64s[i];
+            else writeString(o, strs[i].data(), strs[i].size());
+        }
+        o << ")";
+    }
+
+    void InsertedValue::toSql( GenContext& o ) const
+    {
+        o << o.syntax.insertedBegin;
+        o.ident(field.m_fieldName) << o.syntax.insertedEnd;
+    }
+
+    void Param::toSql( GenContext& o ) const
+    {
+        if (o.syntax.numberedParams) o << "$" << ++o.numParams;
+        else o << "?";
+    }
+
+    SqlPrimaryType SubQuery::getSqlType() const
+    {
+        if (kind!=Scalar) return SqlBool;
+        return sel.m_fields.size()==1 ? sel.m_fields[0]->getSqlType() : SqlNoType;
+    }
+
+    void SubQuery::toSql( GenContext& o ) const
+    {
+        const char* op[]={"(", "EXISTS (", "NOT EXISTS ("};
+        o << op[kind];
+        o.subSelect(sel);
+        o << ")";
+    }
+
+    static void tableToSql( GenContext& o, const Table& t )
+    {
+        if (t.m_select && std::find(o.ctes.begin(), o.ctes.end(), &t)==o.ctes.end()) {
+            o << "(";
+            o.subSelect(*t.m_select);
+            o << ") AS ";
+        }
+        o.ident(t.m_tableName);
+        if (!t.m_alias.empty()) {
+            o << " AS ";
+            o.ident(t.m_alias);
         }
     }
 
@@ -147,34 +1024,70 @@ namespace sqlgen
         o<<"*";
     }
 
+    SqlPrimaryType FuncCall::getSqlType() const
+    {
+        switch(ftype){
+        case Count: return SqlInt;
+        case Avg: return SqlDouble;
+        default: return arg.getSqlType();
+        }
+    }
+
     void FuncCall::toSql( GenContext& o ) const
     {
         const char* op[]={"DISTINCT", "MAX", "MIN", "AVG", "COUNT", "SUM" };
-        o<< op[ftype]<<"(" << arg <<")";
+        o<< op[ftype]<<"(";
+        if (distinctArg) o << "DISTINCT ";
+        if (cond) {
+            o.useBraces=false;
+            o << "CASE WHEN " << *cond << " THEN " << arg << " END";
+        }
+        else o << arg;
+        o <<")";
     }
 
-    void Join::toSql( GenContext& o ) const
+    void AllFields::toSql( GenContext& o ) const
     {
-        sqlAssert(onCond.opType==BinExp::Equ, "join's `on` clause need a equal(==) expression, got: %s.",
-            BinExp::opCppTypeStr(onCond.opType));
+        o << "*";
+    }
+
+    void Case::toSql( GenContext& o ) const
+    {
+        o.useBraces=false;
+        o << "CASE WHEN " << cond << " THEN " << then;
+        if (otherwise) o << " ELSE " << *otherwise;
+        o << " END";
+    }
 
-        o<<fromTable.m_tableName<<" JOIN " << toJoin.m_tableName << " ON " << onCond;
+    void Join::toSql( GenContext& o ) const
+    {
+        sqlAssert(onCond.getSqlType()==SqlBool, "join's `on` clause need a bool expression, got: %s.",
+            primaryTypeStr(onCond.getSqlType()));
+
+        const char* op[]={" JOIN ", " LEFT JOIN ", " RIGHT JOIN "};
+        if (prev) o << *prev;
+        else tableToSql(o, fromTable);
+        o << op[type];
+        tableToSql(o, toJoin);
+        o << " ON " << onCond;
     }
 
-    Join::Join( Table& fromTable_, Table& toJoin_, const BinExp& onCond_ ) :fromTable(fromTable_),toJoin(toJoin_),onCond(onCond_)
+    Join::Join( Table& fromTable_, Table& toJoin_, const Exp& onCond_, JoinType type_, const Join* prev_ ) 
+        :fromTable(fromTable_),toJoin(toJoin_),onCond(onCond_),type(type_),prev(prev_)
     {
         //prevent inlining.
     }
 
 
-    Field::Field( Table* tb, SqlPrimaryType t, const string& name_ ) :m_table(*tb),m_fieldName(name_),Variable(t,m_fieldName)
+    Field::Field( Table* tb, SqlPrimaryType t, const string& name_ ) :Variable(t,m_fieldName),m_table(*tb),m_fieldName(name_)
     {
         //prevent inlining.
     }
 
     void Field::toSql( GenContext& o ) const
     {
-        if (o.useFullFieldName) o<<m_table.m_tableName<<"."; o<<m_fieldName;
+        if (o.useFullFieldName) o.ident(m_table.refName()) << ".";
+        o.ident(m_fieldName);
     }
 
     Field::~Field()
@@ -184,10 +1097,15 @@ namespace sqlgen
 
     void Variable::toSql( GenContext& o ) const
     {
-        o<<m_fieldName;
+        o.ident(m_fieldName);
     }
 
-    Table::Table( const string& name ) :m_tableName(name)
+    Table::Table( const string& name ) :m_tableName(name),m_select(0)
+    {
+        //prevent inlining.
+    }
+
+    Table::Table( const string& name, const Select& s ) :m_tableName(name),m_select(&s)
     {
         //prevent inlining.
     }
@@ -202,7 +1120,7 @@ namespace sqlgen
     //////////////////////////////////////////////////////////////////////////
     
 
-    Select::Select() :m_limit(0),m_offset(0),m_tb(0),m_where(0),m_groupby(0),m_orderby(0),m_join(0),m_having(0)
+    Select::Select() :m_tb(0),m_where(0),m_limit(0),m_offset(0),m_join(0),m_having(0)
     {
         //prevent inlining.
         m_fields.reserve(16);
@@ -213,9 +1131,34 @@ namespace sqlgen
         //prevent inlining.
     }
 
+    Select& Select::reset()
+    {
+        for(int c=ClauseWith; c<=ClauseLimit; c++) clear(Clause(c));
+        m_tb=0;
+        m_join=0;
+        return *this;
+    }
+
+    Select& Select::clear( Clause c )
+    {
+        switch(c){
+        case ClauseWith: m_with.clear(); break;
+        case ClauseFields: m_fields.clear(); break;
+        case ClauseFrom: m_tb=0; m_join=0; c=ClauseFields; break;
+        case ClauseWhere: m_where=0; break;
+        case ClauseGroupBy: m_groupby.clear(); break;
+        case ClauseHaving: m_having=0; break;
+        case ClauseOrderBy: m_orderby.clear(); break;
+        case ClauseLimit: m_limit=m_offset=0; break;
+        }
+        m_cache.touch(c);
+        return *this;
+    }
+
     Select& Select::select( const Exp& f )
     {
         m_fields.push_back(&f);
+        m_cache.touch(ClauseFields);
         return *this;
     }
 
@@ -223,6 +1166,7 @@ namespace sqlgen
     {
         m_fields.push_back(&f);
         m_fields.push_back(&f2);
+        m_cache.touch(ClauseFields);
         return *this;
     }
 
@@ -231,6 +1175,7 @@ namespace sqlgen
         m_fields.push_back(&f);
         m_fields.push_back(&f2);
         m_fields.push_back(&f3);
+        m_cache.touch(ClauseFields);
         return *this;
     }
 
@@ -240,6 +1185,7 @@ namespace sqlgen
         m_fields.push_back(&f2);
         m_fields.push_back(&f3);
         m_fields.push_back(&f4);
+        m_cache.touch(ClauseFields);
         return *this;
     }
 
@@ -250,48 +1196,268 @@ namespace sqlgen
         m_fields.push_back(&f3);
         m_fields.push_back(&f4);
         m_fields.push_back(&f5);
+        m_cache.touch(ClauseFields);
         return *this;
     }       
 
-    string Select::toSql()const
+    Select& Select::groupBy( const Exp& c )
     {
-        GenContext o;
+        m_groupby.push_back(&c);
+        m_cache.touch(ClauseGroupBy);
+        return *this;
+    }
+
+    Select& Select::groupBy( const Exp& c, const Exp& c2 )
+    {
+        m_groupby.push_back(&c);
+        m_groupby.push_back(&c2);
+        m_cache.touch(ClauseGroupBy);
+        return *this;
+    }
+
+    Select& Select::groupBy( const Exp& c, const Exp& c2, const Exp& c3 )
+    {
+        m_groupby.push_back(&c);
+        m_groupby.push_back(&c2);
+        m_groupby.push_back(&c3);
+        m_cache.touch(ClauseGroupBy);
+        return *this;
+    }
+
+    Select& Select::groupBy( const Exp& c, const Exp& c2, const Exp& c3, const Exp& c4 )
+    {
+        m_groupby.push_back(&c);
+        m_groupby.push_back(&c2);
+        m_groupby.push_back(&c3);
+        m_groupby.push_back(&c4);
+        m_cache.touch(ClauseGroupBy);
+        return *this;
+    }
+
+    Select& Select::orderBy( const Exp& c, OrderType order )
+    {
+        OrderKey k={&c, order};
+        m_orderby.push_back(k);
+        m_cache.touch(ClauseOrderBy);
+        return *this;
+    }
+
+    // a constant `GROUP BY` or `ORDER BY` key folded to an integer would be a column number.
+    static void writeKey( GenContext& o, const Exp& e )
+    {
+        bool simplify=o.simplify;
+        if (simplify && evalConst(e).type) o.simplify=false;
+        o << e;
+        o.simplify=simplify;
+    }
+
+    string Select::toSql(SqlDialect d)const
+    {
+        return renderCached(m_cache, d, [this](GenContext& o, int first, RenderCache* cache){ render(o, first, cache); });
+    }
+
+    void Select::render( GenContext& o ) const
+    {
+        render(o, ClauseWith, 0);
+    }
+
+    void Select::render( GenContext& o, int first, RenderCache* c ) const
+    {
+        bool fullFieldName=o.useFullFieldName;
+        size_t numCtes=o.ctes.size();
+        o.useFullFieldName=false;
+        o.useBraces=false;
+
+        // the ctes are needed by the later clauses even when their own is kept.
+        markClause(o, c, ClauseWith);
+        for(unsigned i=0; i<m_with.size(); i++){
+            const Table& t=*m_with[i];
+            sqlAssert(t.m_select, "`with` need a table built from a select: %s", t.m_tableName.c_str());
+            if (first<=ClauseWith) {
+                o << (i ? "," : "WITH ");
+                o.ident(t.m_tableName) << " AS (";
+                o.subSelect(*t.m_select);
+                o << ")";
+            }
+            o.ctes.push_back(&t);
+        }
+        if (m_with.size() && first<=ClauseWith) o << " ";
+
         if (m_join) o.useFullFieldName=true;
+        markClause(o, c, ClauseFields);
+        if (first<=ClauseFields) {
+            o << "SELECT ";
+            for(unsigned i=0; i<m_fields.size(); i++){            
+                if (i) o <<",";             
+                const Exp& f=*m_fields[i];
+                if (f.getRtti()==RttiAlias) {
+                    const Alias& a=static_cast<const Alias&>(f);
+                    o << a.exp << " AS ";
+                    o.ident(a.name);
+                }
+                else o << f;
+            }        
+            if (!m_fields.size()) o << "*";
+        }
 
-        o << "SELECT ";
-        for(unsigned i=0; i<m_fields.size(); i++){            
-            if (i) o <<",";             
-            o << *m_fields[i];
-        }        
-        if (!m_fields.size()) o << "*";
-        if (m_tb || m_join) {
+        markClause(o, c, ClauseFrom);
+        if ((m_tb || m_join) && first<=ClauseFrom) {
             o << " FROM ";
-            if (m_tb) o << m_tb->m_tableName;
+            if (m_tb) tableToSql(o, *m_tb);
             if (m_join) o << *m_join;
+        }
 
-            if (m_where) {            
-                sqlAssert(m_where->getSqlType()==SqlBool, "`where` clause need a bool expression, got: %s", primaryTypeStr(m_where->getSqlType()));
-                o << " WHERE " << *m_where;
-            }
+        markClause(o, c, ClauseWhere);
+        if ((m_tb || m_join) && m_where && first<=ClauseWhere) {            
+            sqlAssert(m_where->getSqlType()==SqlBool, "`where` clause need a bool expression, got: %s", primaryTypeStr(m_where->getSqlType()));
+            o << " WHERE " << *m_where;
         }
 
-        sqlAssert(!m_orderby || !m_groupby, "can't have both `order by` and `group by` clause.");
-        if (m_orderby) o << " ORDER BY " << *m_orderby << (m_orderType==OrderAsc?" ASC ":" DESC ");
-        if (m_groupby) o << " GROUP BY " << *m_groupby;
+        markClause(o, c, ClauseGroupBy);
+        for(unsigned i=0; i<m_groupby.size() && first<=ClauseGroupBy; i++){
+            o << (i ? "," : " GROUP BY ");
+            writeKey(o, *m_groupby[i]);
+        }
+
+        markClause(o, c, ClauseHaving);
+        sqlAssert(!m_having || m_groupby.size(), "`having` clause need a `group by` clause.");
+        if (m_having && first<=ClauseHaving) o << " HAVING " << *m_having;
 
-        if (m_having) o << " HAVING " << *m_having;
+        markClause(o, c, ClauseOrderBy);
+        for(unsigned i=0; i<m_orderby.size() && first<=ClauseOrderBy; i++){
+            const OrderKey& k=m_orderby[i];
+            o << (i ? "," : " ORDER BY ");
+            writeKey(o, *k.exp);
+            o << (k.type==OrderAsc?" ASC":" DESC");
+        }
 
+        markClause(o, c, ClauseLimit);
         sqlAssert(m_limit >= 0, "limit must be a positive value. got: %d", m_limit);
         if (m_limit) o << " LIMIT " << m_limit;
+        else if (m_offset && o.syntax.limitAll) o << " LIMIT " << o.syntax.limitAll;
 
         sqlAssert(m_offset >= 0, "offset must be a positive value. got: %d", m_offset);
         if (m_offset) o << " OFFSET " << m_offset;
-        return o.str();
+
+        o.useFullFieldName=fullFieldName;
+        o.ctes.resize(numCtes);
+    }
+
+    // only an `IN` reachable through `AND`s can be split without changing the result set.
+    static const InList* findChunkableInList( const Exp& e, size_t maxKeys )
+    {
+        if (e.getRtti()==RttiInList) {
+            const InList& in=static_cast<const InList&>(e);
+            return !in.negate && in.count > maxKeys ? &in : 0;
+        }
+        if (e.getRtti()==RttiBinExp) {
+            const BinExp& b=static_cast<const BinExp&>(e);
+            if (b.opType!=BinExp::And) return 0;
+            if (const InList* in=findChunkableInList(b.l, maxKeys)) return in;
+            return findChunkableInList(b.r, maxKeys);
+        }
+        return 0;
+    }
+
+    // an aggregate gives a row per chunk instead of one, `DISTINCT` repeats values across chunks.
+    static bool hasAggregate( const Exp& e )
+    {
+        switch(e.getRtti()){
+        case RttiFuncCall: return true;
+        case RttiAlias: return hasAggregate(static_cast<const Alias&>(e).exp);
+        case RttiBinExp: {
+            const BinExp& b=static_cast<const BinExp&>(e);
+            return hasAggregate(b.l) || hasAggregate(b.r);
+        }
+        case RttiCase: {
+            const Case& c=static_cast<const Case&>(e);
+            return hasAggregate(c.cond) || hasAggregate(c.then) || (c.otherwise && hasAggregate(*c.otherwise));
+        }
+        default: return false;
+        }
+    }
+
+    bool Select::aggregates() const
+    {
+        if (!m_groupby.empty() || m_having) return true;
+        for(unsigned i=0; i<m_fields.size(); i++){
+            if (hasAggregate(*m_fields[i])) return true;
+        }
+        return false;
+    }
+
+    void Select::toSqlChunks( size_t maxKeys, vector<string>& out, SqlDialect d ) const
+    {
+        const InList* in= m_where && maxKeys ? findChunkableInList(*m_where, maxKeys) : 0;
+        bool mergeable= !aggregates() && m_orderby.empty() && !m_limit && !m_offset;
+        if (!in || !mergeable) {
+            out.push_back(toSql(d));
+            return;
+        }
+
+        // the window goes through the context, the statement may be shared between threads.
+        for(size_t b=0; b<in->count; b+=maxKeys){
+            GenContext o(d);
+            o.chunk=in;
+            o.chunkBegin=b;
+            o.chunkEnd= in->count-b > maxKeys ? b+maxKeys : in->count;
+            render(o);
+            out.push_back(o.str());
+        }
+    }
+
+    static void getTables( const Table& t, vector<const Table*>& out )
+    {
+        if (t.m_select) t.m_select->getTables(out);
+        else out.push_back(&t);
+    }
+
+    // tables read by the subqueries of an expression.
+    static void getTables( const Exp* e, vector<const Table*>& out )
+    {
+        if (!e) return;
+        switch(e->getRtti()){
+        case RttiBinExp: 
+            getTables(&static_cast<const BinExp*>(e)->l, out);
+            getTables(&static_cast<const BinExp*>(e)->r, out);
+            break;
+        case RttiAlias: getTables(&static_cast<const Alias*>(e)->exp, out); break;
+        case RttiSubQuery: static_cast<const SubQuery*>(e)->sel.getTables(out); break;
+        case RttiInList: 
+            if (const Select* s=static_cast<const InList*>(e)->sel) s->getTables(out); 
+            getTables(&static_cast<const InList*>(e)->exp, out);
+            break;
+        case RttiFuncCall:
+            getTables(&static_cast<const FuncCall*>(e)->arg, out);
+            getTables(static_cast<const FuncCall*>(e)->cond, out);
+            break;
+        case RttiCase:
+            getTables(&static_cast<const Case*>(e)->cond, out);
+            getTables(&static_cast<const Case*>(e)->then, out);
+            getTables(static_cast<const Case*>(e)->otherwise, out);
+            break;
+        default: break; // no subquery in fields, literals and params.
+        }
+    }
+
+    void Select::getTables( vector<const Table*>& out ) const
+    {
+        if (m_tb) sqlgen::getTables(*m_tb, out);
+        for(const Join* j=m_join; j; j=j->prev){
+            sqlgen::getTables(j->toJoin, out);
+            sqlgen::getTables(&j->onCond, out);
+            if (!j->prev) sqlgen::getTables(j->fromTable, out);
+        }
+        for(unsigned i=0; i<m_fields.size(); i++) sqlgen::getTables(m_fields[i], out);
+        sqlgen::getTables(m_where, out);
+        for(unsigned i=0; i<m_groupby.size(); i++) sqlgen::getTables(m_groupby[i], out);
+        sqlgen::getTables(m_having, out);
+        for(unsigned i=0; i<m_orderby.size(); i++) sqlgen::getTables(m_orderby[i].exp, out);
     }
 
     //////////////////////////////////////////////////////////////////////////
 
-    Update::Update()
+    Update::Update():m_table(0),m_where(0)
     {
         //prevent inlining.
         m_values.reserve(16);
@@ -302,9 +1468,26 @@ namespace sqlgen
         //prevent inlining.
     }
 
+    Update& Update::reset()
+    {
+        clear(ClauseSet);
+        clear(ClauseWhere);
+        m_table=0;
+        return *this;
+    }
+
+    Update& Update::clear( Clause c )
+    {
+        if (c==ClauseSet) m_values.clear();
+        if (c==ClauseWhere) m_where=0;
+        m_cache.touch(c);
+        return *this;
+    }
+
     Update& Update::set( const BinExp& v )
     {
         m_values.push_back(&v);
+        m_cache.touch(ClauseSet);
         return *this;
     }
 
@@ -312,6 +1495,7 @@ namespace sqlgen
     {
         m_values.push_back(&v);
         m_values.push_back(&v2);
+        m_cache.touch(ClauseSet);
         return *this;
     }
 
@@ -320,6 +1504,7 @@ namespace sqlgen
         m_values.push_back(&v);
         m_values.push_back(&v2);
         m_values.push_back(&v3);
+        m_cache.touch(ClauseSet);
         return *this;
     }
 
@@ -329,6 +1514,7 @@ namespace sqlgen
         m_values.push_back(&v2);
         m_values.push_back(&v3);
         m_values.push_back(&v4);
+        m_cache.touch(ClauseSet);
         return *this;
     }
 
@@ -339,29 +1525,52 @@ namespace sqlgen
         m_values.push_back(&v3);
         m_values.push_back(&v4);
         m_values.push_back(&v5);
+        m_cache.touch(ClauseSet);
         return *this;
     }
 
-    string Update::toSql() const
+    string Update::toSql(SqlDialect d) const
     {        
-        GenContext o;
-        o << "UPDATE " << m_table->m_tableName <<" SET ";
-        for(unsigned i=0; i<m_values.size(); i++){
-            const BinExp& v=*m_values[i];
-            sqlAssert(v.opType==BinExp::Assign, "`set` clause need an assign expression, got: %s", BinExp::opCppTypeStr(v.opType));
-            if (i) o<<",";
-            o<< v;
-        }
-        if (m_where) {
-            sqlAssert(m_where->getSqlType()==SqlBool, "`where` clause need a bool exp, got: %s", primaryTypeStr(m_where->getSqlType())); 
-            o << " WHERE " << *m_where;
-        }
-        return o.str();
+        return renderCached(m_cache, d, [this](GenContext& o, int first, RenderCache* cache){
+            markClause(o, cache, ClauseTable);
+            if (first<=ClauseTable) {
+                o << "UPDATE ";
+                o.ident(m_table->m_tableName) << " SET ";
+            }
+            markClause(o, cache, ClauseSet);
+            for(unsigned i=0; i<m_values.size() && first<=ClauseSet; i++){
+                const BinExp& v=*m_values[i];
+                sqlAssert(v.opType==BinExp::Assign, "`set` clause need an assign expression, got: %s", BinExp::opCppTypeStr(v.opType));
+                if (i) o<<",";
+                o<< v;
+            }
+            markClause(o, cache, ClauseWhere);
+            if (m_where) {
+                sqlAssert(m_where->getSqlType()==SqlBool, "`where` clause need a bool exp, got: %s", primaryTypeStr(m_where->getSqlType())); 
+                o << " WHERE " << *m_where;
+            }
+        });
     }
 
     //////////////////////////////////////////////////////////////////////////
 
-    Insert::Insert():m_numcols(0)
+    InsertValue::InsertValue( const BinExp& v ) :col(&v.l),exp(0),inserted(0)
+    {
+        sqlAssert(v.opType==BinExp::Assign, "`values()` and `onDuplicateKeyUpdate()` need assign expressions, got: %s", BinExp::opCppTypeStr(v.opType));
+
+        if (v.r.getRtti()==RttiLiteral) lit = static_cast<const Literal&>(v.r);
+        else if (v.r.getRtti()==RttiInsertedValue) inserted = &static_cast<const InsertedValue&>(v.r).field;
+        else exp = &v.r;
+    }
+
+    void InsertValue::valueToSql( GenContext& o ) const
+    {
+        if (exp) o << *exp;
+        else if (inserted) o << InsertedValue(*inserted);
+        else o << lit;
+    }
+
+    Insert::Insert():m_table(0),m_numcols(0)
     {
         //prevent inlining.
         m_values.reserve(32);
@@ -372,48 +1581,116 @@ namespace sqlgen
         //prevent inlining.
     }
 
+    Insert& Insert::reset()
+    {
+        clear(ClauseValues);
+        clear(ClauseUpsert);
+        m_table=0;
+        return *this;
+    }
+
+    Insert& Insert::clear( Clause c )
+    {
+        if (c==ClauseValues) {
+            m_values.clear();
+            m_numcols=0;
+            c=ClauseTable;  // the columns go with the rows.
+        }
+        if (c==ClauseUpsert) {
+            m_conflictKeys.clear();
+            m_updates.clear();
+        }
+        m_cache.touch(c);
+        return *this;
+    }
+
     Insert& Insert::values( const BinExp& v )
     {
         setNumColums(1);
-        m_values.push_back(&v);
+        m_values.push_back(InsertValue(v));
         return *this;
     }
 
     Insert& Insert::values( const BinExp& v, const BinExp& v2 )
     {
         setNumColums(2);
-        m_values.push_back(&v);
-        m_values.push_back(&v2);
+        m_values.push_back(InsertValue(v));
+        m_values.push_back(InsertValue(v2));
         return *this;
     }
 
     Insert& Insert::values( const BinExp& v, const BinExp& v2, const BinExp& v3 )
     {
         setNumColums(3);
-        m_values.push_back(&v);
-        m_values.push_back(&v2);
-        m_values.push_back(&v3);
+        m_values.push_back(InsertValue(v));
+        m_values.push_back(InsertValue(v2));
+        m_values.push_back(InsertValue(v3));
         return *this;
     }
 
     Insert& Insert::values( const BinExp& v, const BinExp& v2, const BinExp& v3, const BinExp& v4 )
     {
         setNumColums(4);
-        m_values.push_back(&v);
-        m_values.push_back(&v2);
-        m_values.push_back(&v3);
-        m_values.push_back(&v4);
+        m_values.push_back(InsertValue(v));
+        m_values.push_back(InsertValue(v2));
+        m_values.push_back(InsertValue(v3));
+        m_values.push_back(InsertValue(v4));
         return *this;
     }
 
     Insert& Insert::values( const BinExp& v, const BinExp& v2, const BinExp& v3, const BinExp& v4, const BinExp& v5 )
     {
         setNumColums(5);
-        m_values.push_back(&v);
-        m_values.push_back(&v2);
-        m_values.push_back(&v3);
-        m_values.push_back(&v4);
-        m_values.push_back(&v5);
+        m_values.push_back(InsertValue(v));
+        m_values.push_back(InsertValue(v2));
+        m_values.push_back(InsertValue(v3));
+        m_values.push_back(InsertValue(v4));
+        m_values.push_back(InsertValue(v5));
+        return *this;
+    }
+
+    Insert& Insert::onDuplicateKeyUpdate( const BinExp& v )
+    {
+        m_updates.push_back(InsertValue(v));
+        m_cache.touch(ClauseUpsert);
+        return *this;
+    }
+
+    Insert& Insert::onDuplicateKeyUpdate( const BinExp& v, const BinExp& v2 )
+    {
+        m_updates.push_back(InsertValue(v));
+        m_updates.push_back(InsertValue(v2));
+        m_cache.touch(ClauseUpsert);
+        return *this;
+    }
+
+    Insert& Insert::onDuplicateKeyUpdate( const BinExp& v, const BinExp& v2, const BinExp& v3 )
+    {
+        m_updates.push_back(InsertValue(v));
+        m_updates.push_back(InsertValue(v2));
+        m_updates.push_back(InsertValue(v3));
+        m_cache.touch(ClauseUpsert);
+        return *this;
+    }
+
+    Insert& Insert::onDuplicateKeyUpdate( const BinExp& v, const BinExp& v2, const BinExp& v3, const BinExp& v4 )
+    {
+        m_updates.push_back(InsertValue(v));
+        m_updates.push_back(InsertValue(v2));
+        m_updates.push_back(InsertValue(v3));
+        m_updates.push_back(InsertValue(v4));
+        m_cache.touch(ClauseUpsert);
+        return *this;
+    }
+
+    Insert& Insert::onDuplicateKeyUpdate( const BinExp& v, const BinExp& v2, const BinExp& v3, const BinExp& v4, const BinExp& v5 )
+    {
+        m_updates.push_back(InsertValue(v));
+        m_updates.push_back(InsertValue(v2));
+        m_updates.push_back(InsertValue(v3));
+        m_updates.push_back(InsertValue(v4));
+        m_updates.push_back(InsertValue(v5));
+        m_cache.touch(ClauseUpsert);
         return *this;
     }
 
@@ -423,45 +1700,78 @@ namespace sqlgen
             sqlAssert(m_numcols==numCols, "values should have same number of colums. expect %d, got %d.", m_numcols, numCols);
         }
         m_numcols = numCols;
+        // the first row gives the columns.
+        m_cache.touch(m_values.empty() ? ClauseTable : ClauseValues);
     }
 
-    string Insert::toSql()const
+    const char* Insert::error( SqlDialect d ) const
     {
-        GenContext o;
+        if (m_updates.size() && m_conflictKeys.empty() && dialects[d].conflictTarget)
+            return "an upsert needs its unique key, see onConflict().";
+        return 0;
+    }
 
-        o << "INSERT INTO " << m_table->m_tableName << "(";
-        for(int i=0; i<m_numcols; i++){
-            const BinExp& v = *m_values[i];
-            if (i>0) o<<",";
-            o << v.l;
-        }  
-        o << ") VALUES ";
+    string Insert::toSql(SqlDialect d)const
+    {
+        sqlAssert(!error(d), "%s", error(d));
+        return renderCached(m_cache, d, [this](GenContext& o, int first, RenderCache* cache){
+            markClause(o, cache, ClauseTable);
+            if (first<=ClauseTable) {
+                o << "INSERT INTO ";
+                o.ident(m_table->m_tableName) << "(";
+                for(int i=0; i<m_numcols; i++){
+                    if (i>0) o<<",";
+                    o << *m_values[i].col;
+                }  
+                o << ") VALUES ";
+            }
 
-        int nrow = m_values.size()/m_numcols;
-        int i=0;
-        for(int r=0; r<nrow; r++){
-            if (r) o<<",";
-            for(int c=0; c<m_numcols; c++){
-                const BinExp& v = *m_values[i++];
-                sqlAssert(v.opType==BinExp::Assign, "`values()` function need assign expressions, got: %s", BinExp::opCppTypeStr(v.opType)); 
+            markClause(o, cache, ClauseValues);
+            int nrow = first<=ClauseValues ? m_values.size()/m_numcols : 0;
+            int i=0;
+            for(int r=0; r<nrow; r++){
+                if (r) o<<",";
+                for(int c=0; c<m_numcols; c++){
+                    if (!c) o<<"(";
+                    else o<<",";
+                    m_values[i++].valueToSql(o);
+                    if (c==m_numcols-1) o << ")";
+                }            
+            }
 
-                if (!c) o<<"(";
-                else o<<",";
-                o << v.r;
-                if (c==m_numcols-1) o << ")";
-            }            
-        }
-        return o.str();
+            markClause(o, cache, ClauseUpsert);
+            if (m_updates.size()) {
+                if (o.syntax.conflictTarget) {
+                    o << " ON CONFLICT";
+                    for(unsigned k=0; k<m_conflictKeys.size(); k++){
+                        o << (k ? "," : "(") << *m_conflictKeys[k];
+                        if (k==m_conflictKeys.size()-1) o << ")";
+                    }
+                }
+                o << o.syntax.upsert;
+
+                for(unsigned k=0; k<m_updates.size(); k++){
+                    if (k) o << ",";
+                    o << *m_updates[k].col << "=";
+                    m_updates[k].valueToSql(o);
+                }
+            }
+        });
     }
 
     //////////////////////////////////////////////////////////////////////////
 
-    string Delete::toSql() const
+    string Delete::toSql(SqlDialect d) const
     {
-        GenContext o;
-        o << "DELETE FROM " << m_table->m_tableName;
-        if (m_where) o << " WHERE "<< *m_where;
-        return o.str();
+        return renderCached(m_cache, d, [this](GenContext& o, int first, RenderCache* cache){
+            markClause(o, cache, ClauseTable);
+            if (first<=ClauseTable) {
+                o << "DELETE FROM ";
+                o.ident(m_table->m_tableName);
+            }
+            markClause(o, cache, ClauseWhere);
+            if (m_where) o << " WHERE "<< *m_where;
+        });
     }
 
 
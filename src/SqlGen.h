@@ -3,26 +3,62 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
 
 namespace sqlgen
 {
-    enum SqlPrimaryType { SqlNoType, SqlNull, SqlString, SqlInt, SqlBool, SqlFloat };
+    enum SqlPrimaryType { SqlNoType, SqlNull, SqlString, SqlInt, SqlBool, SqlFloat, SqlInt64, SqlDouble, SqlDateTime, SqlBlob };
 
-    enum RuntimeType { RttiNone, RttiBinExp, /*TODO*/ };
+    enum RuntimeType { RttiNone, RttiBinExp, RttiAlias, RttiInList, RttiLiteral, RttiInsertedValue, RttiParam, RttiSubQuery, RttiFuncCall, RttiCase, /*TODO*/ };
+
+    enum SqlDialect { DialectMysql, DialectSqlite, DialectPostgres };
 
     struct GenContext;
+    struct Select;
+    template<typename T> struct TBinExp;
     using std::string;
     using std::vector;
 
     typedef int(*LogAssert)(const char*);
     void setAssertLogger(LogAssert l);
 
+    // dialect used by toSql() when none is given.
+    void        setDefaultDialect(SqlDialect d);
+    SqlDialect  getDefaultDialect();
+    // quote table, field and alias names with the dialect's identifier quote.
+    void        setQuoteIdentifiers(bool v);
+    // fold constants, drop redundant `AND`/`OR` terms, move constants off indexed columns
+    // (`age+10 > 20` is `age > 10`) and only parenthesize where precedence needs it.
+    void        setSimplifyExpressions(bool v);
+    // capacity up to which per thread render buffers are kept for reuse, 0 to never reuse them.
+    void        setRenderBufferLimit(size_t bytes);
+
+    struct Alias;
+
+    // a DATETIME value, no time zone attached.
+    struct DateTime
+    {
+        int year, month, day, hour, minute, second;
+
+        static DateTime fromTime(long long unixSeconds);
+        long long       toTime()const;
+    };
+
+    // binary data, rendered as a hex literal and decoded without stopping at NULs.
+    struct Blob
+    {
+        string data;
+
+        Blob(){}
+        Blob(const void* p, size_t n):data(static_cast<const char*>(p), n){}
+    };
  
     struct Exp
     {
         virtual void            toSql(GenContext& o)const = 0;     
         virtual SqlPrimaryType  getSqlType() const=0;
         virtual RuntimeType     getRtti()const{ return RttiNone;}
+        Alias                   as(const char* name)const;
     };
         
     inline GenContext& operator<<(GenContext& o, const Exp& i){ i.toSql(o); return o; }
@@ -30,17 +66,36 @@ namespace sqlgen
     struct Literal : Exp
     {
         SqlPrimaryType type;
-        int i;
-        float f;
+        union {
+            int i;
+            float f;
+            long long i64;
+            double d;
+            bool b;
+            DateTime t;
+        };
         const char* l;        
-
-        Literal():type(SqlNoType){}
-        Literal(const char* l_):l(l_),type(SqlString){}
-        Literal(const string& l_):l(l_.c_str()),type(SqlString){}
-        Literal(int ii):i(ii),type(SqlInt){}
-        Literal(float ff):f(ff),type(SqlFloat){}
+        size_t len;             // length of l, -1 when it's only known to be zero terminated.
+
+        // t is the widest member, value initializing it zeroes the whole union.
+        Literal():type(SqlNoType),t(),l(0),len(0){}
+        Literal(const char* l_):type(SqlString),t(),l(l_),len(size_t(-1)){}
+        Literal(const string& l_):type(SqlString),t(),l(l_.c_str()),len(l_.size()){}
+        Literal(const Blob& b_):type(SqlBlob),t(),l(b_.data.data()),len(b_.data.size()){}
+        Literal(int ii):type(SqlInt),t(),l(0),len(0){ i=ii; }
+        Literal(long ii):type(SqlInt64),t(),l(0),len(0){ i64=ii; }
+        Literal(long long ii):type(SqlInt64),t(),l(0),len(0){ i64=ii; }
+        // above LLONG_MAX they wrap, sqlite and postgres have no unsigned 64 bit type.
+        Literal(unsigned ii):type(SqlInt64),t(),l(0),len(0){ i64=ii; }
+        Literal(unsigned long ii):type(SqlInt64),t(),l(0),len(0){ i64=static_cast<long long>(ii); }
+        Literal(unsigned long long ii):type(SqlInt64),t(),l(0),len(0){ i64=static_cast<long long>(ii); }
+        Literal(bool bb):type(SqlBool),t(),l(0),len(0){ b=bb; }
+        Literal(float ff):type(SqlFloat),t(),l(0),len(0){ f=ff; }
+        Literal(double dd):type(SqlDouble),t(),l(0),len(0){ d=dd; }
+        Literal(const DateTime& tt):type(SqlDateTime),t(tt),l(0),len(0){}
 
         SqlPrimaryType  getSqlType()const{return type;}
+        RuntimeType     getRtti()const{return RttiLiteral;}
         void            toSql(GenContext& o)const;
     };
 
@@ -61,6 +116,34 @@ namespace sqlgen
     };
 
 
+    // `exp IN (k1,k2,...)`, the keys are rendered straight from the caller's container,
+    // which must outlive the statement. or `exp IN (SELECT ...)`.
+    struct InList : Exp
+    {
+        const Exp&      exp;
+        bool            negate;
+        SqlPrimaryType  keyType;
+        const int*      ints;
+        const long long* int64s;
+        const string*   strs;
+        const Select*   sel;
+        size_t          count;
+
+        InList(const Exp& e, bool neg, const int* keys, size_t n)
+            :exp(e),negate(neg),keyType(SqlInt),ints(keys),int64s(0),strs(0),sel(0),count(n){}
+        InList(const Exp& e, bool neg, const long long* keys, size_t n)
+            :exp(e),negate(neg),keyType(SqlInt64),ints(0),int64s(keys),strs(0),sel(0),count(n){}
+        InList(const Exp& e, bool neg, const string* keys, size_t n)
+            :exp(e),negate(neg),keyType(SqlString),ints(0),int64s(0),strs(keys),sel(0),count(n){}
+        InList(const Exp& e, bool neg, const Select& s)
+            :exp(e),negate(neg),keyType(SqlNoType),ints(0),int64s(0),strs(0),sel(&s),count(0){}
+        // the key i as a literal.
+        Literal         key(size_t i)const{return ints ? Literal(ints[i]) : int64s ? Literal(int64s[i]) : Literal(strs[i]);}
+        SqlPrimaryType  getSqlType()const{return SqlBool;}
+        RuntimeType     getRtti()const{return RttiInList;}
+        void            toSql(GenContext& o)const;
+    };
+
     struct Variable : Exp
     {
         SqlPrimaryType      m_type;
@@ -70,31 +153,121 @@ namespace sqlgen
         void            toSql(GenContext& o)const;
         SqlPrimaryType  getSqlType()const{return m_type;}
         BinExp          like(const Literal& s){return BinExp(BinExp::Like, *this, s);}
+        InList          in(const vector<int>& keys)const{return InList(*this, false, keys.data(), keys.size());}
+        InList          in(const vector<long long>& keys)const{return InList(*this, false, keys.data(), keys.size());}
+        InList          in(const vector<string>& keys)const{return InList(*this, false, keys.data(), keys.size());}
+        InList          notIn(const vector<int>& keys)const{return InList(*this, true, keys.data(), keys.size());}
+        InList          notIn(const vector<long long>& keys)const{return InList(*this, true, keys.data(), keys.size());}
+        InList          notIn(const vector<string>& keys)const{return InList(*this, true, keys.data(), keys.size());}
+        InList          in(const Select& s)const{return InList(*this, false, s);}
+        InList          notIn(const Select& s)const{return InList(*this, true, s);}
         BinExp          operator=(const Literal& l){return BinExp(BinExp::Assign, *this, l);}
+        BinExp          operator=(const Exp& e){return BinExp(BinExp::Assign, *this, e);}
+    };
+
+    // a select used as an expression: `(SELECT ...)`, `EXISTS (SELECT ...)`.
+    struct SubQuery : Exp
+    {
+        enum Kind{ Scalar, Exists, NotExists } kind;
+        const Select& sel;
+
+        SubQuery(Kind k, const Select& s):kind(k),sel(s){}
+        SqlPrimaryType  getSqlType()const;
+        RuntimeType     getRtti()const{return RttiSubQuery;}
+        void            toSql(GenContext& o)const;
+    };
+
+    inline SubQuery subquery(const Select& s)   {return SubQuery(SubQuery::Scalar, s);}
+    inline SubQuery exists(const Select& s)     {return SubQuery(SubQuery::Exists, s);}
+    inline SubQuery notExists(const Select& s)  {return SubQuery(SubQuery::NotExists, s);}
+
+    // a statement parameter: `?` in mysql and sqlite, `$1`, `$2`... in postgres.
+    struct Param : Exp
+    {
+        SqlPrimaryType type;
+
+        explicit Param(SqlPrimaryType t):type(t){}
+        SqlPrimaryType  getSqlType()const{return type;}
+        RuntimeType     getRtti()const{return RttiParam;}
+        void            toSql(GenContext& o)const;
     };
 
+    inline Param param(SqlPrimaryType t){return Param(t);}
+
     struct Star : Exp
     {
         SqlPrimaryType  getSqlType()const{return SqlNoType;}
         void            toSql(GenContext& o)const;
     };
 
+    // `CASE WHEN cond THEN then ELSE otherwise END`, NULL when there's no otherwise.
+    struct Case : Exp
+    {
+        const Exp& cond;
+        const Exp& then;
+        const Exp* otherwise;
+
+        Case(const Exp& c, const Exp& t, const Exp* e):cond(c),then(t),otherwise(e){}
+        SqlPrimaryType  getSqlType()const{return then.getSqlType();}
+        RuntimeType     getRtti()const{return RttiCase;}
+        void            toSql(GenContext& o)const;
+    };
+
+    // `*`, to select every column along with other expressions: select(allFields(), score*2).
+    struct AllFields : Exp
+    {
+        SqlPrimaryType  getSqlType()const{return SqlNoType;}
+        void            toSql(GenContext& o)const;
+    };
+
+    inline const AllFields& allFields(){ static const AllFields all; return all; }
+
+    inline Case caseWhen(const Exp& c, const Exp& t)                    {return Case(c, t, 0);}
+    inline Case caseWhen(const Exp& c, const Exp& t, const Exp& e)      {return Case(c, t, &e);}
+
+    // aggregates, `SUM(DISTINCT arg)` when distinctArg, `SUM(CASE WHEN cond THEN arg END)` with a cond.
     struct FuncCall : Exp
     {
         const Exp& arg;
         enum FuncType{ Distinct, Max, Min, Avg, Count, Sum, } ftype ;
+        bool distinctArg;
+        const Exp* cond;
         
-        FuncCall(FuncType t, const Exp& a): ftype(t),arg(a){}
-        SqlPrimaryType  getSqlType()const{return arg.getSqlType();}
+        FuncCall(FuncType t, const Exp& a, bool d=false, const Exp* c=0): arg(a),ftype(t),distinctArg(d),cond(c){}
+        SqlPrimaryType  getSqlType()const;
+        RuntimeType     getRtti()const{return RttiFuncCall;}
         void            toSql(GenContext& o)const;
     };
 
+    inline const Literal& literalOne(){ static const Literal one(1); return one; }
+
     inline FuncCall max(const Exp& e)       {return FuncCall(FuncCall::Max, e);}
     inline FuncCall avg(const Exp& e)       {return FuncCall(FuncCall::Avg, e);}
     inline FuncCall min(const Exp& e)       {return FuncCall(FuncCall::Min, e);}
     inline FuncCall count(const Exp& e)     {return FuncCall(FuncCall::Count, e);}
     inline FuncCall sum(const Exp& e)       {return FuncCall(FuncCall::Sum, e);}
     inline FuncCall distinct(const Exp& e)  {return FuncCall(FuncCall::Distinct, e);}
+    inline FuncCall countDistinct(const Exp& e)             {return FuncCall(FuncCall::Count, e, true);}
+    inline FuncCall sumDistinct(const Exp& e)               {return FuncCall(FuncCall::Sum, e, true);}
+    inline FuncCall countIf(const Exp& c)                   {return FuncCall(FuncCall::Count, literalOne(), false, &c);}
+    inline FuncCall sumIf(const Exp& c, const Exp& e)       {return FuncCall(FuncCall::Sum, e, false, &c);}
+    inline FuncCall avgIf(const Exp& c, const Exp& e)       {return FuncCall(FuncCall::Avg, e, false, &c);}
+    inline FuncCall maxIf(const Exp& c, const Exp& e)       {return FuncCall(FuncCall::Max, e, false, &c);}
+    inline FuncCall minIf(const Exp& c, const Exp& e)       {return FuncCall(FuncCall::Min, e, false, &c);}
+
+    // `exp AS name` in the select list, just `name` everywhere else(order by, group by, having).
+    struct Alias : Exp
+    {
+        const Exp&  exp;
+        const char* name;
+
+        Alias(const Exp& e, const char* n):exp(e),name(n){}
+        SqlPrimaryType  getSqlType()const{return exp.getSqlType();}
+        RuntimeType     getRtti()const{return RttiAlias;}
+        void            toSql(GenContext& o)const;
+    };
+
+    inline Alias Exp::as(const char* name)const{return Alias(*this, name);}
 
 
 
@@ -116,45 +289,143 @@ namespace sqlgen
         using Variable::operator=;
     };
 
+    enum JoinType { JoinInner, JoinLeft, JoinRight };
+
+    // one step of a join chain, `prev` holds the steps before it:
+    // a.join(b, on).leftJoin(c, on2) is `a JOIN b ON on LEFT JOIN c ON on2`.
     struct Join : Exp
     {
         Table& fromTable;
         Table& toJoin;
-        const BinExp& onCond;
+        const Exp& onCond;
+        JoinType type;
+        const Join* prev;
 
-        Join(Table& fromTable_, Table& toJoin_, const BinExp& onCond_);
+        Join(Table& fromTable_, Table& toJoin_, const Exp& onCond_, JoinType type_=JoinInner, const Join* prev_=0);
         SqlPrimaryType  getSqlType()const{return SqlNoType;}
         void            toSql(GenContext& o)const;
+        Join join(Table& t, const Exp& on)const{ return Join(fromTable, t, on, JoinInner, this);}
+        Join leftJoin(Table& t, const Exp& on)const{ return Join(fromTable, t, on, JoinLeft, this);}
+        Join rightJoin(Table& t, const Exp& on)const{ return Join(fromTable, t, on, JoinRight, this);}
     };
 
     struct Table
     {
-        string m_tableName;
+        string          m_tableName;
+        string          m_alias;    // `Users AS boss`, for joining a table with itself.
+        const Select*   m_select;   // for a derived table or a cte: `(SELECT ...) AS name`.
 
         explicit Table(const string& name);
+        Table(const string& name, const Select& s);
         ~Table();
-        Join join(Table& t, const BinExp& on){ return Join(*this, t, on);}
+        Table& alias(const string& a){ m_alias=a; return *this;}
+        // the name fields are qualified with.
+        const string& refName()const{ return m_alias.empty() ? m_tableName : m_alias;}
+        Join join(Table& t, const Exp& on){ return Join(*this, t, on);}
+        Join leftJoin(Table& t, const Exp& on){ return Join(*this, t, on, JoinLeft);}
+        Join rightJoin(Table& t, const Exp& on){ return Join(*this, t, on, JoinRight);}
+    };
+
+    // the value a row would have been inserted with, in the update list of an upsert:
+    // `VALUES(col)` in mysql, `excluded.col` in sqlite.
+    struct InsertedValue : Exp
+    {
+        const Field& field;
+
+        explicit InsertedValue(const Field& f):field(f){}
+        SqlPrimaryType  getSqlType()const{return field.getSqlType();}
+        RuntimeType     getRtti()const{return RttiInsertedValue;}
+        void            toSql(GenContext& o)const;
     };
 
+    inline InsertedValue values(const Field& f){return InsertedValue(f);}
+
     //////////////////////////////////////////////////////////////////////////
 
     
+    // `col=value` copied out of an assign expression, so rows can be added in a loop:
+    // literals and inserted values are kept by value, other expressions by reference.
+    struct InsertValue
+    {
+        const Exp*      col;
+        const Exp*      exp;
+        const Field*    inserted;
+        Literal         lit;
+
+        explicit InsertValue(const BinExp& v);
+        void    valueToSql(GenContext& o)const;
+    };
+
+    // the sql last rendered by a statement reused with cacheSql() and where each of its clauses
+    // begins, the next toSql() only renders again from the first clause changed since. the
+    // setters mark their clause and the selects nested in a clause are checked for changes,
+    // call touch() after changing anything else in place, e.g. a member or a literal. while a
+    // thread renders a statement, the others render it the plain way.
+    struct RenderCache
+    {
+        enum { MaxClauses=8 };
+
+        // a select nested in a clause, with the version it was rendered at.
+        struct Nested
+        {
+            const RenderCache*  cache;
+            unsigned            version;
+            int                 clause;
+        };
+
+        string          sql;
+        size_t          begin[MaxClauses];
+        int             params[MaxClauses];     // numbered params rendered before each clause.
+        unsigned        dirty;                  // a bit per clause changed since sql was rendered.
+        unsigned        key;                    // the dialect and options sql was rendered with.
+        unsigned        version;                // bumped by every change.
+        vector<Nested>  nested;
+        bool            enabled;
+        std::atomic<bool> busy;
+
+        RenderCache():dirty(~0u),key(0),version(0),enabled(false),busy(false){}
+        RenderCache(const RenderCache& c):busy(false){ *this=c; }
+        RenderCache& operator=(const RenderCache& c);
+        void    touch(int clause){dirty |= 1u<<clause; version++;}
+        void    touch(){dirty = ~0u; version++;}
+    };
+
     struct Insert
     {
+        enum Clause { ClauseTable, ClauseValues, ClauseUpsert };
+
         const Table*            m_table;        
-        vector<const BinExp*>   m_values;
+        vector<InsertValue>     m_values;
         int                     m_numcols;
+        vector<const Exp*>      m_conflictKeys;
+        vector<InsertValue>     m_updates;
+        mutable RenderCache     m_cache;
         
         Insert();
         ~Insert();
         void    setNumColums(int numCols);
-        Insert& insertInto(const Table& tt){m_table=&tt; return *this;}        
+        // empty the statement to build another one, its buffers are kept.
+        Insert& reset();
+        // drop the rows, or the upsert, to give other ones.
+        Insert& clear(Clause c);
+        // keep the rendered sql for the next toSql(), see RenderCache.
+        Insert& cacheSql(bool on=true){m_cache.enabled=on; m_cache.touch(); return *this;}
+        Insert& insertInto(const Table& tt){m_table=&tt; m_cache.touch(ClauseTable); return *this;}        
         Insert& values(const BinExp& v);
         Insert& values(const BinExp& v, const BinExp& v2);
         Insert& values(const BinExp& v, const BinExp& v2, const BinExp& v3);
         Insert& values(const BinExp& v, const BinExp& v2, const BinExp& v3, const BinExp& v4);
         Insert& values(const BinExp& v, const BinExp& v2, const BinExp& v3, const BinExp& v4, const BinExp& v5);
-        string  toSql()const;
+        // the unique key of the upsert, needed by sqlite and postgres, ignored by mysql.
+        Insert& onConflict(const Exp& key){m_conflictKeys.push_back(&key); m_cache.touch(ClauseUpsert); return *this;}
+        Insert& onDuplicateKeyUpdate(const BinExp& v);
+        Insert& onDuplicateKeyUpdate(const BinExp& v, const BinExp& v2);
+        Insert& onDuplicateKeyUpdate(const BinExp& v, const BinExp& v2, const BinExp& v3);
+        Insert& onDuplicateKeyUpdate(const BinExp& v, const BinExp& v2, const BinExp& v3, const BinExp& v4);
+        Insert& onDuplicateKeyUpdate(const BinExp& v, const BinExp& v2, const BinExp& v3, const BinExp& v4, const BinExp& v5);
+        string  toSql(SqlDialect d=getDefaultDialect())const;
+        // why the statement isn't valid sql in d, null when it is. execute() doesn't run it then.
+        const char* error(SqlDialect d=getDefaultDialect())const;
         operator string()const{return toSql();}
     };
 
@@ -164,120 +435,175 @@ namespace sqlgen
         OrderDesc
     };
 
+    struct OrderKey
+    {
+        const Exp*  exp;
+        OrderType   type;
+    };
+
     struct Select
     {
+        // in rendering order.
+        enum Clause { ClauseWith, ClauseFields, ClauseFrom, ClauseWhere, ClauseGroupBy, ClauseHaving, ClauseOrderBy, ClauseLimit };
+
         Table*              m_tb;
         const Exp*          m_where;
-        const Field*        m_groupby;
-        const Field*        m_orderby;
-        OrderType           m_orderType;
+        vector<const Exp*>  m_groupby;
+        vector<OrderKey>    m_orderby;
         int                 m_limit, m_offset;
         vector<const Exp*>  m_fields;        
         const Join*         m_join;
         const BinExp*       m_having;
+        vector<const Table*> m_with;
+        mutable RenderCache m_cache;
 
         Select();
         ~Select();
+        // empty the statement to build another one, its buffers are kept.
+        Select& reset();
+        // drop a clause to give another one: clear(ClauseOrderBy).orderBy(...), ClauseLimit 
+        // drops the offset too. clauses holding one thing are replaced by their setter as well.
+        Select& clear(Clause c);
+        // keep the rendered sql for the next toSql(), see RenderCache.
+        Select& cacheSql(bool on=true){m_cache.enabled=on; m_cache.touch(); return *this;}
         Select& select(const Exp& f);
         Select& select(const Exp& f, const Exp& f2);
         Select& select(const Exp& f, const Exp& f2, const Exp& f3);
         Select& select(const Exp& f, const Exp& f2, const Exp& f3, const Exp& f4);
         Select& select(const Exp& f, const Exp& f2, const Exp& f3, const Exp& f4, const Exp& f5);
-        Select& from(Table& t){m_tb = &t; return *this;}
-        Select& from(const Join& j){m_join = &j;return *this;}   
-        Select& where(const Exp& c){m_where = &c; return *this;}
-        Select& groupBy(const Field& c){ m_groupby=&c; return *this; }
-        Select& orderBy(const Field& c, OrderType order=OrderAsc){m_orderby=&c; m_orderType=order; return *this;}
-        Select& having(const BinExp& c){m_having=&c; return *this;}
-        Select& limit(int v){ m_limit=v; return *this; }
-        Select& offset(int v){m_offset=v; return *this;}
-        string  toSql() const;
+        Select& from(Table& t){m_tb = &t; m_cache.touch(ClauseFrom); return *this;}
+        // joined fields render with their table name, the fields change too.
+        Select& from(const Join& j){m_join = &j; m_cache.touch(ClauseFields); return *this;}   
+        // `WITH name AS (SELECT ...)`, the table must be built from a select.
+        Select& with(const Table& cte){m_with.push_back(&cte); m_cache.touch(ClauseWith); return *this;}
+        Select& where(const Exp& c){m_where = &c; m_cache.touch(ClauseWhere); return *this;}
+        template<typename T> Select& where(const TBinExp<T>& c);  // SqlTyped.h
+        Select& groupBy(const Exp& c);
+        Select& groupBy(const Exp& c, const Exp& c2);
+        Select& groupBy(const Exp& c, const Exp& c2, const Exp& c3);
+        Select& groupBy(const Exp& c, const Exp& c2, const Exp& c3, const Exp& c4);
+        Select& orderBy(const Exp& c, OrderType order=OrderAsc);
+        Select& having(const BinExp& c){m_having=&c; m_cache.touch(ClauseHaving); return *this;}
+        template<typename T> Select& having(const TBinExp<T>& c);
+        Select& limit(int v){ m_limit=v; m_cache.touch(ClauseLimit); return *this; }
+        Select& offset(int v){m_offset=v; m_cache.touch(ClauseLimit); return *this;}
+        string  toSql(SqlDialect d=getDefaultDialect()) const;
+        void    render(GenContext& o) const;
+        // the clauses from `first` on, their positions kept in c if any.
+        void    render(GenContext& o, int first, RenderCache* c) const;
+        // split an oversized `IN` list of the where clause into several statements 
+        // of at most maxKeys keys each. the rows of the chunks are merged as is, so a grouped,
+        // ordered, limited or aggregated select stays a single statement.
+        void    toSqlChunks(size_t maxKeys, vector<string>& out, SqlDialect d=getDefaultDialect()) const;
+        // aggregates, `DISTINCT`, `GROUP BY` or `HAVING`: the rows of several runs over parts
+        // of the data can't just be concatenated.
+        bool    aggregates() const;
+        // the tables read by this statement.
+        void    getTables(vector<const Table*>& out) const;
         operator string() const{return toSql();}
     };
     
     struct Update 
     {
+        enum Clause { ClauseTable, ClauseSet, ClauseWhere };
+
         Table*                  m_table;
         vector<const BinExp*>   m_values;
         const Exp*              m_where;
+        mutable RenderCache     m_cache;
 
         Update();
         ~Update();
-        Update& update(Table& t){m_table=&t; return *this; }        
+        // empty the statement to build another one, its buffers are kept.
+        Update& reset();
+        // drop the assignments, or the where clause, to give other ones.
+        Update& clear(Clause c);
+        // keep the rendered sql for the next toSql(), see RenderCache.
+        Update& cacheSql(bool on=true){m_cache.enabled=on; m_cache.touch(); return *this;}
+        Update& update(Table& t){m_table=&t; m_cache.touch(ClauseTable); return *this; }        
         Update& set(const BinExp& v);
         Update& set(const BinExp& v, const BinExp& v2);
         Update& set(const BinExp& v, const BinExp& v2, const BinExp& v3);
         Update& set(const BinExp& v, const BinExp& v2, const BinExp& v3, const BinExp& v4);
         Update& set(const BinExp& v, const BinExp& v2, const BinExp& v3, const BinExp& v4, const BinExp& v5);        
-        Update& where(const Exp& v){m_where = &v;return *this;}
-        string  toSql()const;
+        template<typename T> Update& set(const TBinExp<T>& v);    // SqlTyped.h
+        Update& where(const Exp& v){m_where = &v; m_cache.touch(ClauseWhere); return *this;}
+        template<typename T> Update& where(const TBinExp<T>& v);
+        string  toSql(SqlDialect d=getDefaultDialect())const;
         operator string()const{return toSql();}
     };
 
 
     struct Delete
     {
-        Table*      m_table;
-        const Exp*  m_where;
+        enum Clause { ClauseTable, ClauseWhere };
+
+        Table*              m_table;
+        const Exp*          m_where;
+        mutable RenderCache m_cache;
 
         Delete():m_table(0),m_where(0){}
-        Delete& from(Table& t){m_table=&t; return *this;}
-        Delete& where(const Exp& e){m_where=&e; return *this;}
-        string  toSql()const;
+        Delete& reset(){m_table=0; m_where=0; m_cache.touch(); return *this;}
+        // keep the rendered sql for the next toSql(), see RenderCache.
+        Delete& cacheSql(bool on=true){m_cache.enabled=on; m_cache.touch(); return *this;}
+        Delete& from(Table& t){m_table=&t; m_cache.touch(ClauseTable); return *this;}
+        Delete& where(const Exp& e){m_where=&e; m_cache.touch(ClauseWhere); return *this;}
+        template<typename T> Delete& where(const TBinExp<T>& e);  // SqlTyped.h
+        string  toSql(SqlDialect d=getDefaultDialect())const;
         operator string()const{return toSql();}
     };
 
 #define OP +
 #define TYPE Add
-#include __FILE__
+#include "SqlGen.h"
 
 #define OP -
 #define TYPE Sub
-#include __FILE__
+#include "SqlGen.h"
 
 #define OP *
 #define TYPE Mul
-#include __FILE__
+#include "SqlGen.h"
 
 #define OP /
 #define TYPE Div
-#include __FILE__
+#include "SqlGen.h"
 
 #define OP %
 #define TYPE Mod
-#include __FILE__
+#include "SqlGen.h"
 
 #define OP &&
 #define TYPE And
-#include __FILE__
+#include "SqlGen.h"
 
 #define OP ||
 #define TYPE Or
-#include __FILE__
+#include "SqlGen.h"
 
 #define OP >
 #define TYPE LargerThan
-#include __FILE__
+#include "SqlGen.h"
 
 #define OP <
 #define TYPE LessThan
-#include __FILE__
+#include "SqlGen.h"
 
 #define OP ==
 #define TYPE Equ
-#include __FILE__
+#include "SqlGen.h"
 
 #define OP <=
 #define TYPE LessEqu
-#include __FILE__
+#include "SqlGen.h"
 
 #define OP >=
 #define TYPE LargerEqu
-#include __FILE__
+#include "SqlGen.h"
 
 #define OP !=
 #define TYPE NotEqu
-#include __FILE__
+#include "SqlGen.h"
 }
 
 #pragma once
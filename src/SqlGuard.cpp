@@ -0,0 +1,186 @@
+#include "stdafx.h"
+#include "SqlGuard.h"
+#include <algorithm>
+#include <thread>
+
+
+namespace sqlgen{
+
+    typedef std::chrono::steady_clock Clock;
+
+    // one thread cancelling the statements past their deadline for all guarded connections.
+    struct Watchdog
+    {
+        struct Timer
+        {
+            Clock::time_point   at;
+            SqlConnection*      con;
+            bool                fired;
+            bool                cancelling;     // con->cancel() is running, outside the lock.
+        };
+
+        std::mutex              lock;
+        std::condition_variable changed, cancelled;
+        std::vector<Timer*>     timers;
+        bool                    started;
+
+        Watchdog():started(false){}
+
+        void arm(Timer& t)
+        {
+            std::lock_guard<std::mutex> g(lock);
+            t.fired = false;
+            t.cancelling = false;
+            timers.push_back(&t);
+            if (!started) {
+                started = true;
+                std::thread(&Watchdog::run, this).detach();
+            }
+            changed.notify_one();
+        }
+
+        // true if the timer fired. once this returns, it can't cancel anything anymore.
+        bool disarm(Timer& t)
+        {
+            std::unique_lock<std::mutex> g(lock);
+            std::vector<Timer*>::iterator it = std::find(timers.begin(), timers.end(), &t);
+            if (it != timers.end()) timers.erase(it);
+            cancelled.wait(g, [&t]{ return !t.cancelling; });
+            return t.fired;
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> g(lock);
+            for(;;){
+                if (timers.empty()) {
+                    changed.wait(g);
+                    continue;
+                }
+                Clock::time_point next = timers[0]->at;
+                for(unsigned i=1; i<timers.size(); i++) next = std::min(next, timers[i]->at);
+                if (next > Clock::now()) {
+                    changed.wait_until(g, next);
+                    continue;
+                }
+
+                // a statement finishing right now may get its successor cancelled, only
+                // if it's not yet disarmed though, which happens right after it returns.
+                Clock::time_point now = Clock::now();
+                std::vector<Timer*> expired;
+                for(unsigned i=0; i<timers.size(); ){
+                    Timer* t = timers[i];
+                    if (t->at > now) { i++; continue; }
+                    t->fired = true;
+                    t->cancelling = true;
+                    expired.push_back(t);
+                    timers.erase(timers.begin()+i);
+                }
+
+                // cancel() may be slow(mysql sends KILL QUERY to the server) or run guarded
+                // statements itself, the others can arm and disarm meanwhile. the expired
+                // timers stay alive, their disarm() waits for cancelling to be cleared.
+                g.unlock();
+                for(unsigned i=0; i<expired.size(); i++) expired[i]->con->cancel();
+                g.lock();
+                for(unsigned i=0; i<expired.size(); i++) expired[i]->cancelling = false;
+                cancelled.notify_all();
+            }
+        }
+    };
+
+    // never destroyed, its thread may still be waiting at exit.
+    static Watchdog& watchdog()
+    {
+        static Watchdog* w = new Watchdog;
+        return *w;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    InFlightLimiter::InFlightLimiter( int maxInFlight_, int maxQueued_, int maxWaitMs )
+        :maxInFlight(maxInFlight_),maxQueued(maxQueued_),maxWait(std::chrono::milliseconds(maxWaitMs))
+        ,inFlight(0),queued(0),peakQueued(0),admitted(0),rejected(0),waitedUs(0)
+    {
+    }
+
+    bool InFlightLimiter::acquire()
+    {
+        std::unique_lock<std::mutex> g(lock);
+        if (inFlight < maxInFlight) {
+            inFlight++;
+            admitted++;
+            return true;
+        }
+        if (queued >= maxQueued) {
+            rejected++;
+            return false;
+        }
+
+        Clock::time_point begin = Clock::now();
+        queued++;
+        peakQueued = std::max(peakQueued, queued);
+        bool ok = freed.wait_until(g, begin+maxWait, [this]{ return inFlight < maxInFlight; });
+        queued--;
+        if (!ok) {
+            rejected++;
+            return false;
+        }
+        inFlight++;
+        admitted++;
+        waitedUs += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-begin).count();
+        return true;
+    }
+
+    void InFlightLimiter::release()
+    {
+        {
+            std::lock_guard<std::mutex> g(lock);
+            inFlight--;
+        }
+        freed.notify_one();
+    }
+
+    std::string InFlightLimiter::stats()
+    {
+        std::lock_guard<std::mutex> g(lock);
+        char buf[256];
+        snprintf(buf, sizeof(buf), "in flight %d/%d, queued %d/%d(peak %d), admitted %lld, rejected %lld, avg wait %lldus",
+            inFlight, maxInFlight, queued, maxQueued, peakQueued, admitted, rejected, admitted ? waitedUs/admitted : 0);
+        return buf;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    GuardedConnection::GuardedConnection( SqlConnection& target_, int timeoutMs_, InFlightLimiter* limiter_ )
+        :target(target_),limiter(limiter_),timeoutMs(timeoutMs_),timeouts(0),rejections(0),failure(0)
+    {
+    }
+
+    SqlResultReader* GuardedConnection::execute( const char* sql )
+    {
+        failure = 0;
+        if (limiter && !limiter->acquire()) {
+            rejections++;
+            failure = "rejected: too many statements in flight";
+            return 0;
+        }
+
+        Watchdog::Timer t;
+        if (timeoutMs) {
+            t.at = Clock::now() + std::chrono::milliseconds(timeoutMs);
+            t.con = &target;
+            watchdog().arm(t);
+        }
+        SqlResultReader* r = target.execute(sql);
+        bool fired = timeoutMs && watchdog().disarm(t);
+        if (limiter) limiter->release();
+
+        // it may still have completed before noticing the cancel.
+        if (fired && !r && *target.error()) {
+            timeouts++;
+            failure = "statement timed out";
+        }
+        return r;
+    }
+}
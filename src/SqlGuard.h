@@ -0,0 +1,52 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include "SqlUtils.h"
+
+namespace sqlgen
+{
+    // bounds the statements running at once over all the connections sharing it. the others
+    // wait in a bounded queue, and are rejected when it's full or they waited maxWaitMs.
+    struct InFlightLimiter
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        int                     maxInFlight, maxQueued;
+        Clock::duration         maxWait;
+        std::mutex              lock;
+        std::condition_variable freed;
+        int                     inFlight, queued, peakQueued;
+        long long               admitted, rejected;
+        long long               waitedUs;   // total time admitted statements spent queued.
+
+        InFlightLimiter(int maxInFlight_, int maxQueued_, int maxWaitMs);
+        bool        acquire();
+        void        release();
+        std::string stats();
+
+    private:
+        InFlightLimiter(const InFlightLimiter&);
+        InFlightLimiter& operator=(const InFlightLimiter&);
+    };
+
+    // forwards to another connection, cancelling statements still running after timeoutMs
+    // and waiting for the limiter first if any. a cancelled or rejected statement fails
+    // like any other, see error().
+    struct GuardedConnection : SqlConnection
+    {
+        SqlConnection&      target;
+        InFlightLimiter*    limiter;
+        int                 timeoutMs;      // 0 for none.
+        int                 timeouts, rejections;
+        const char*         failure;        // why the last statement failed here, if it did.
+
+        GuardedConnection(SqlConnection& target_, int timeoutMs_, InFlightLimiter* limiter_=0);
+        SqlDialect          dialect()const{return target.dialect();}
+        SqlResultReader*    execute(const char* sql);
+        const char*         error(){return failure ? failure : target.error();}
+        void                cancel(){target.cancel();}
+        int&                transactionDepth(){return target.transactionDepth();}
+        std::vector<std::string>& transactionWrites(){return target.transactionWrites();}
+    };
+}
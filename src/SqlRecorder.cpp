@@ -0,0 +1,152 @@
+#include "stdafx.h"
+#include "SqlRecorder.h"
+#include "SqlExplain.h"
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+
+namespace sqlgen{
+
+    static const char recordingMagic[8] = {'S','Q','L','R','E','C','1',0};
+
+    unsigned long long shapeHash( const std::string& sql, SqlDialect d )
+    {
+        std::string shape = queryShape(sql, d);
+        unsigned long long h = 14695981039346656037ull;
+        for(size_t i=0; i<shape.size(); i++){
+            h ^= static_cast<unsigned char>(shape[i]);
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    RecordingConnection::RecordingConnection( SqlConnection& target_, const char* path )
+        :target(target_),file(fopen(path, "wb")),started(Clock::now()),recorded(0)
+    {
+        if (file) fwrite(recordingMagic, 1, sizeof(recordingMagic), file);
+    }
+
+    RecordingConnection::~RecordingConnection()
+    {
+        if (file) fclose(file);
+    }
+
+    SqlResultReader* RecordingConnection::execute( const char* sql )
+    {
+        Clock::time_point begin = Clock::now();
+        SqlResultReader* r = target.execute(sql);
+        Clock::time_point end = Clock::now();
+        if (!file) return r;
+
+        // the shape is hashed outside the lock, only the write is serialized.
+        long long startUs = std::chrono::duration_cast<std::chrono::microseconds>(begin-started).count();
+        unsigned long long shape = shapeHash(sql, target.dialect());
+        unsigned durationUs = static_cast<unsigned>(std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count());
+        int rows = r ? r->nrows : -1;
+        unsigned char failed = !r && *target.error();
+        unsigned len = static_cast<unsigned>(strlen(sql));
+
+        std::lock_guard<std::mutex> g(lock);
+        fwrite(&startUs, sizeof(startUs), 1, file);
+        fwrite(&shape, sizeof(shape), 1, file);
+        fwrite(&durationUs, sizeof(durationUs), 1, file);
+        fwrite(&rows, sizeof(rows), 1, file);
+        fwrite(&failed, sizeof(failed), 1, file);
+        fwrite(&len, sizeof(len), 1, file);
+        fwrite(sql, 1, len, file);
+        recorded++;
+        return r;
+    }
+
+    bool loadRecording( const char* path, std::vector<RecordedStatement>& out )
+    {
+        FILE* f = fopen(path, "rb");
+        if (!f) return false;
+
+        char magic[sizeof(recordingMagic)];
+        bool ok = fread(magic, 1, sizeof(magic), f)==sizeof(magic) && !memcmp(magic, recordingMagic, sizeof(magic));
+        while (ok) {
+            RecordedStatement s;
+            unsigned char failed;
+            unsigned len;
+            if (fread(&s.startUs, sizeof(s.startUs), 1, f)!=1) break;
+            ok = fread(&s.shape, sizeof(s.shape), 1, f)==1
+                && fread(&s.durationUs, sizeof(s.durationUs), 1, f)==1
+                && fread(&s.rows, sizeof(s.rows), 1, f)==1
+                && fread(&failed, sizeof(failed), 1, f)==1
+                && fread(&len, sizeof(len), 1, f)==1;
+            if (!ok) break;
+            s.failed = failed!=0;
+            s.sql.resize(len);
+            ok = !len || fread(&s.sql[0], 1, len, f)==len;
+            if (ok) out.push_back(std::move(s));
+        }
+        fclose(f);
+        return ok;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    std::string ReplayReport::str() const
+    {
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%d statements in %.3fs, %d failed, %d row count mismatches\n"
+            "latency us: p50 %u, p90 %u, p99 %u, max %u\n",
+            statements, wallUs/1e6, failed, rowMismatches, p50Us, p90Us, p99Us, maxUs);
+        return buf;
+    }
+
+    ReplayReport replay( const std::vector<RecordedStatement>& log, const std::vector<SqlConnection*>& workers, double speed )
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        // the log is written as statements complete, they are issued as they started.
+        std::vector<size_t> order(log.size());
+        for(size_t i=0; i<order.size(); i++) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){ return log[a].startUs < log[b].startUs; });
+
+        std::vector<unsigned> latencies(log.size());
+        std::atomic<size_t> next(0);
+        std::atomic<int> failed(0), mismatches(0);
+        Clock::time_point started = Clock::now();
+
+        auto work = [&](SqlConnection* c){
+            for(size_t i; (i=next++) < log.size(); ){
+                const RecordedStatement& s = log[order[i]];
+                if (speed > 0) std::this_thread::sleep_until(started + std::chrono::microseconds(static_cast<long long>(s.startUs/speed)));
+
+                Clock::time_point begin = Clock::now();
+                SqlResultReader* r = c->execute(s.sql.c_str());
+                latencies[i] = static_cast<unsigned>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-begin).count());
+
+                if (!r && *c->error()) failed++;
+                else if ((r ? r->nrows : -1) != s.rows) mismatches++;
+                delete r;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for(size_t i=1; i<workers.size(); i++) threads.emplace_back(work, workers[i]);
+        if (!workers.empty()) work(workers[0]);
+        for(size_t i=0; i<threads.size(); i++) threads[i].join();
+
+        ReplayReport rep = {};
+        rep.statements = static_cast<int>(log.size());
+        rep.failed = failed;
+        rep.rowMismatches = mismatches;
+        rep.wallUs = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-started).count();
+        if (!latencies.empty()) {
+            std::sort(latencies.begin(), latencies.end());
+            size_t n = latencies.size();
+            rep.p50Us = latencies[n*50/100];
+            rep.p90Us = latencies[n*90/100];
+            rep.p99Us = latencies[n*99/100];
+            rep.maxUs = latencies[n-1];
+        }
+        return rep;
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+#include "SqlUtils.h"
+
+namespace sqlgen
+{
+    struct RecordedStatement
+    {
+        long long           startUs;    // since the recording began.
+        unsigned long long  shape;      // shapeHash() of the sql.
+        unsigned            durationUs;
+        int                 rows;       // -1 when there was no result set.
+        bool                failed;
+        std::string         sql;
+    };
+
+    // hash of queryShape(), equal for statements only differing by their literals.
+    unsigned long long shapeHash(const std::string& sql, SqlDialect d=getDefaultDialect());
+
+    // forwards everything to another connection and appends each statement to a binary log:
+    // an 8 bytes header then per statement startUs(i64) shape(u64) durationUs(u32) rows(i32)
+    // failed(u8) sqlLen(u32) sql, all in host byte order.
+    struct RecordingConnection : SqlConnection
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        SqlConnection&      target;
+        FILE*               file;
+        std::mutex          lock;
+        Clock::time_point   started;
+        int                 recorded;
+
+        RecordingConnection(SqlConnection& target_, const char* path);
+        ~RecordingConnection();
+        bool                ok()const{return file!=0;}
+        SqlDialect          dialect()const{return target.dialect();}
+        SqlResultReader*    execute(const char* sql);
+        const char*         error(){return target.error();}
+        void                cancel(){target.cancel();}
+        int&                transactionDepth(){return target.transactionDepth();}
+        std::vector<std::string>& transactionWrites(){return target.transactionWrites();}
+    };
+
+    bool loadRecording(const char* path, std::vector<RecordedStatement>& out);
+
+    struct ReplayReport
+    {
+        int         statements, failed, rowMismatches;
+        long long   wallUs;
+        unsigned    p50Us, p90Us, p99Us, maxUs;
+
+        std::string str()const;
+    };
+
+    // re-issues a recording spread over the given connections, one thread each, keeping the
+    // recorded start times divided by speed(0 to not wait at all). statements are handed out
+    // by start time to whichever worker is free, use a single connection to keep transactions intact.
+    ReplayReport replay(const std::vector<RecordedStatement>& log, const std::vector<SqlConnection*>& workers, double speed);
+}
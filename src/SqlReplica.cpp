@@ -0,0 +1,176 @@
+#include "stdafx.h"
+#include "SqlReplica.h"
+#include <ctype.h>
+
+
+namespace sqlgen{
+
+    static bool startsWithWord( const char* s, const char* word )
+    {
+        for(; *word; s++, word++){
+            if (toupper(static_cast<unsigned char>(*s)) != *word) return false;
+        }
+        return !isalnum(static_cast<unsigned char>(*s)) && *s!='_';
+    }
+
+    // the closing quote of the string or identifier starting at p, null when it isn't closed.
+    // mysql escapes with backslashes, all of them double the quote.
+    static const char* skipQuoted( const char* p, SqlDialect d )
+    {
+        char q = *p;
+        for(p++; *p; p++){
+            if (*p=='\\' && d==DialectMysql && p[1]) p++;
+            else if (*p==q) {
+                if (p[1]!=q) return p;
+                p++;
+            }
+        }
+        return 0;
+    }
+
+    // `FOR UPDATE`, `FOR SHARE`, `FOR NO KEY UPDATE`, `FOR KEY SHARE` or `LOCK IN SHARE MODE`.
+    static bool locksRows( const char* sql, SqlDialect d )
+    {
+        for(const char* p=sql; *p; p++){
+            if (*p=='\'' || *p=='"' || *p=='`') {
+                if (!(p=skipQuoted(p, d))) return false;
+                continue;
+            }
+            if (p>sql && (isalnum(static_cast<unsigned char>(p[-1])) || p[-1]=='_')) continue;
+            bool forClause = startsWithWord(p, "FOR");
+            if (!forClause && !startsWithWord(p, "LOCK")) continue;
+            const char* q = p + (forClause ? 3 : 4);
+            while (isspace(static_cast<unsigned char>(*q))) q++;
+            if (forClause ? startsWithWord(q, "UPDATE") || startsWithWord(q, "SHARE") || startsWithWord(q, "NO") || startsWithWord(q, "KEY")
+                : startsWithWord(q, "IN")) return true;
+        }
+        return false;
+    }
+
+    bool isReadOnly( const char* sql, SqlDialect d )
+    {
+        while (isspace(static_cast<unsigned char>(*sql)) || *sql=='(') sql++;
+        if (startsWithWord(sql, "SELECT")) return !locksRows(sql, d);
+        if (!startsWithWord(sql, "WITH")) return false;
+
+        // a postgres WITH may hold writes: check each cte, then the statement after the last
+        // one, the first thing closing back to the top level not followed by another cte or AS.
+        int depth = 0;
+        for(const char* p=sql; *p; p++){
+            if (*p=='\'') {
+                if (!(p=skipQuoted(p, d))) return false;
+            }
+            else if (*p=='(' && depth++==0) {
+                const char* q = p+1;
+                while (isspace(static_cast<unsigned char>(*q))) q++;
+                if (startsWithWord(q, "INSERT") || startsWithWord(q, "UPDATE") || startsWithWord(q, "DELETE")) return false;
+            }
+            else if (*p==')' && --depth==0) {
+                const char* q = p+1;
+                while (isspace(static_cast<unsigned char>(*q))) q++;
+                if (*q==',' || *q=='(' || startsWithWord(q, "AS") || startsWithWord(q, "NOT") || startsWithWord(q, "MATERIALIZED")) continue;
+                return startsWithWord(q, "SELECT") && !locksRows(sql, d);
+            }
+        }
+        return false;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    ReplicaPool::ReplicaPool( const std::vector<SqlConnection*>& replicas_, int maxLagMs )
+        :maxLag(std::chrono::milliseconds(maxLagMs)),next(0),replicaReads(0),primaryReads(0),writes(0),fallbacks(0)
+    {
+        for(unsigned i=0; i<replicas_.size(); i++){
+            replicas.emplace_back(new Replica);
+            replicas.back()->con = replicas_[i];
+            replicas.back()->load = 0;
+        }
+    }
+
+    ReplicaPool::Replica* ReplicaPool::acquire()
+    {
+        std::lock_guard<std::mutex> g(lock);
+        if (replicas.empty()) return 0;
+
+        // ties go round robin.
+        unsigned n = static_cast<unsigned>(replicas.size());
+        Replica* best = 0;
+        for(unsigned i=0; i<n; i++){
+            Replica* r = replicas[(next+i)%n].get();
+            if (!best || r->load < best->load) best = r;
+        }
+        next = (next+1)%n;
+        best->load++;
+        replicaReads++;
+        return best;
+    }
+
+    void ReplicaPool::release( Replica* r )
+    {
+        std::lock_guard<std::mutex> g(lock);
+        r->load--;
+    }
+
+    std::string ReplicaPool::stats()
+    {
+        std::lock_guard<std::mutex> g(lock);
+        char buf[256];
+        snprintf(buf, sizeof(buf), "replica reads %lld, primary reads %lld, writes %lld, fallbacks %lld",
+            replicaReads, primaryReads, writes, fallbacks);
+        return buf;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    ReplicaSession::ReplicaSession( ReplicaPool& pool_, SqlConnection& primary_ )
+        :pool(pool_),primary(primary_),running(0)
+    {
+    }
+
+    bool ReplicaSession::pinned() const
+    {
+        return txDepth > 0 || Clock::now() < pinnedUntil;
+    }
+
+    void ReplicaSession::cancel()
+    {
+        if (SqlConnection* c = running.load()) c->cancel();
+    }
+
+    SqlResultReader* ReplicaSession::execute( const char* sql )
+    {
+        bool read = isReadOnly(sql, dialect());
+        if (read && !pinned()) {
+            if (ReplicaPool::Replica* rep = pool.acquire()) {
+                SqlResultReader* r;
+                {
+                    std::lock_guard<std::mutex> g(rep->lock);
+                    running = rep->con;
+                    r = rep->con->execute(sql);
+                    running = 0;
+                    err = rep->con->error();
+                }
+                pool.release(rep);
+                if (r || err.empty()) return r;
+
+                // the replica is down or lagging behind a schema change, the primary has it all.
+                std::lock_guard<std::mutex> g(pool.lock);
+                pool.fallbacks++;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> g(pool.lock);
+            if (read) pool.primaryReads++;
+            else pool.writes++;
+        }
+        running = &primary;
+        SqlResultReader* r = primary.execute(sql);
+        running = 0;
+        err = primary.error();
+        // replicas only start applying a write once it's done, pinned from its end. a write in
+        // a transaction is applied at its COMMIT, which is a write too.
+        if (!read) pinnedUntil = Clock::now() + pool.maxLag;
+        return r;
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include "SqlUtils.h"
+
+namespace sqlgen
+{
+    // whether a statement only reads: a SELECT or WITH ... SELECT, as Select renders, which
+    // doesn't lock rows with FOR UPDATE/SHARE or LOCK IN SHARE MODE. d tells how strings escape.
+    bool isReadOnly(const char* sql, SqlDialect d=getDefaultDialect());
+
+    // read replicas shared by several sessions. each replica runs one statement at a time,
+    // a read goes to the one with the fewest statements running or waiting.
+    struct ReplicaPool
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        struct Replica
+        {
+            SqlConnection*  con;
+            std::mutex      lock;
+            int             load;   // statements running or waiting on it.
+        };
+
+        std::vector<std::unique_ptr<Replica>>   replicas;
+        Clock::duration                         maxLag;     // how far behind the primary replicas may be.
+        std::mutex                              lock;
+        unsigned                                next;
+        long long                               replicaReads, primaryReads, writes, fallbacks;
+
+        ReplicaPool(const std::vector<SqlConnection*>& replicas_, int maxLagMs);
+        // the least loaded replica, counted as loaded until release().
+        Replica*    acquire();
+        void        release(Replica* r);
+        std::string stats();
+
+    private:
+        ReplicaPool(const ReplicaPool&);
+        ReplicaPool& operator=(const ReplicaPool&);
+    };
+
+    // one client's connection: writes, transactions, locking reads and the reads following the
+    // end of a write by less than the pool's maxLag go to its own primary connection, so it reads
+    // its writes. other reads go to a replica, or to the primary when the replica fails.
+    struct ReplicaSession : SqlConnection
+    {
+        typedef ReplicaPool::Clock Clock;
+
+        ReplicaPool&            pool;
+        SqlConnection&          primary;
+        Clock::time_point       pinnedUntil;
+        std::atomic<SqlConnection*> running;    // for cancel().
+        std::string             err;        // copied while the connection was ours, replicas are shared.
+
+        ReplicaSession(ReplicaPool& pool_, SqlConnection& primary_);
+        SqlDialect          dialect()const{return primary.dialect();}
+        SqlResultReader*    execute(const char* sql);
+        const char*         error(){return err.c_str();}
+        void                cancel();
+        // true while reads stick to the primary.
+        bool                pinned()const;
+    };
+}
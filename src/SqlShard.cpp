@@ -0,0 +1,279 @@
+#include "stdafx.h"
+#include "SqlShard.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+
+namespace sqlgen{
+
+    int hashShard( const Literal& key, int numShards )
+    {
+        long long v;
+        switch(key.type){
+        case SqlInt: v = key.i; break;
+        case SqlInt64: v = key.i64; break;
+        case SqlString: {
+            size_t n = key.len==size_t(-1) ? strlen(key.l) : key.len;
+            unsigned long long h = 14695981039346656037ull;
+            for(size_t i=0; i<n; i++){
+                h ^= static_cast<unsigned char>(key.l[i]);
+                h *= 1099511628211ull;
+            }
+            return static_cast<int>(h % numShards);
+        }
+        default: return 0;
+        }
+        return static_cast<int>((v % numShards + numShards) % numShards);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    ShardRouter::ShardRouter( const std::vector<SqlConnection*>& shards_, const Field& key_, ShardFunc f )
+        :shards(shards_),key(key_),shardOf(f)
+    {
+    }
+
+    // marks the shards `e` can match, false when it doesn't restrict them.
+    static bool pinnedShards( const ShardRouter& r, const Exp& e, std::vector<char>& hit )
+    {
+        int n = static_cast<int>(r.shards.size());
+        if (e.getRtti()==RttiInList) {
+            const InList& in = static_cast<const InList&>(e);
+            if (&in.exp != &r.key || in.negate || in.sel) return false;
+            for(size_t i=0; i<in.count; i++){
+                hit[r.shardOf(in.key(i), n)] = 1;
+            }
+            return true;
+        }
+        if (e.getRtti()!=RttiBinExp) return false;
+
+        const BinExp& b = static_cast<const BinExp&>(e);
+        if (b.opType==BinExp::And || b.opType==BinExp::Or) {
+            std::vector<char> l(n), rr(n);
+            bool pl = pinnedShards(r, b.l, l), pr = pinnedShards(r, b.r, rr);
+            for(int i=0; i<n; i++){
+                if (b.opType==BinExp::Or) hit[i] |= l[i] | rr[i];
+                else hit[i] |= pl && pr ? l[i] & rr[i] : pl ? l[i] : rr[i];
+            }
+            return b.opType==BinExp::Or ? pl && pr : pl || pr;
+        }
+        if (b.opType!=BinExp::Equ) return false;
+
+        const Exp* k = &b.l;
+        const Exp* v = &b.r;
+        if (k != &r.key) std::swap(k, v);
+        if (k != &r.key || v->getRtti()!=RttiLiteral) return false;
+        hit[r.shardOf(static_cast<const Literal&>(*v), n)] = 1;
+        return true;
+    }
+
+    std::vector<int> ShardRouter::route( const Exp* where ) const
+    {
+        std::vector<char> hit(shards.size());
+        bool pinned = where && pinnedShards(*this, *where, hit);
+        std::vector<int> ret;
+        for(unsigned i=0; i<shards.size(); i++){
+            if (!pinned || hit[i]) ret.push_back(i);
+        }
+        return ret;
+    }
+
+    bool ShardRouter::run( const std::vector<int>& targets, const std::vector<std::string>& sqls, std::vector<SqlResultReader*>* results )
+    {
+        std::vector<std::string> errors(targets.size());
+        if (results) results->assign(targets.size(), 0);
+
+        auto work = [&](size_t i){
+            SqlConnection& c = *shards[targets[i]];
+            SqlResultReader* r = c.execute(sqls[i].c_str());
+            if (!r && *c.error()) errors[i] = c.error();
+            if (results && r) (*results)[i] = storeResult(r);
+            else delete r;
+        };
+
+        std::vector<std::thread> threads;
+        for(size_t i=1; i<targets.size(); i++) threads.emplace_back(work, i);
+        if (!targets.empty()) work(0);
+        for(size_t i=0; i<threads.size(); i++) threads[i].join();
+
+        err.clear();
+        for(size_t i=0; i<errors.size(); i++){
+            if (errors[i].empty()) continue;
+            err = "shard " + std::to_string(targets[i]) + ": " + errors[i];
+            return false;
+        }
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    // NULLs first, then by the declared type of the key: numbers by value, the rest bytewise.
+    // strtold keeps 64 bit ints exact where long double is wider than double.
+    static int compareFields( SqlPrimaryType t, const char* a, size_t na, const char* b, size_t nb )
+    {
+        if (!a || !b) return !b - !a;
+        switch(t){
+        case SqlInt: case SqlInt64: case SqlFloat: case SqlDouble: {
+            long double x = strtold(a, 0), y = strtold(b, 0);
+            return x<y ? -1 : x>y;
+        }
+        default: break;
+        }
+        int c = memcmp(a, b, std::min(na, nb));
+        return c ? c : na<nb ? -1 : na>nb;
+    }
+
+    SqlResultReader* ShardRouter::select( const Select& s )
+    {
+        std::vector<int> targets = route(s.m_where);
+        if (targets.size()==1) {
+            // long IN lists are still split into chunks.
+            SqlConnection& c = *shards[targets[0]];
+            SqlResultReader* r = executeSelect(c, s);
+            err = r || !*c.error() ? "" : c.error();
+            return r;
+        }
+        // one row per shard would pass for the whole result.
+        if (s.aggregates()) {
+            err = "an aggregated, grouped or distinct select must be pinned to one shard";
+            return 0;
+        }
+
+        // every shard returns its first offset+limit rows, with the order keys not selected
+        // appended: keyCols[i] is the column of key i, or -1-k for the kth appended one.
+        Select part = s;
+        part.offset(0);
+        if (s.m_limit) part.limit(s.m_limit + s.m_offset);
+        if (s.m_fields.empty() && s.m_orderby.size()) part.select(allFields());
+        std::vector<int> keyCols;
+        std::vector<SqlPrimaryType> keyTypes;
+        int extra = 0;
+        for(unsigned i=0; i<s.m_orderby.size(); i++){
+            const Exp* k = s.m_orderby[i].exp;
+            keyTypes.push_back(k->getSqlType());
+            int col = -1-extra;
+            for(unsigned j=0; j<s.m_fields.size(); j++){
+                const Exp* f = s.m_fields[j];
+                if (f==k || (f->getRtti()==RttiAlias && &static_cast<const Alias*>(f)->exp==k)) col = j;
+            }
+            if (col < 0) {
+                part.select(*k);
+                extra++;
+            }
+            keyCols.push_back(col);
+        }
+
+        std::vector<std::string> sqls;
+        for(unsigned i=0; i<targets.size(); i++) sqls.push_back(part.toSql(shards[targets[i]]->dialect()));
+        std::vector<SqlResultReader*> readers;
+        bool ok = run(targets, sqls, &readers);
+        std::vector<std::unique_ptr<StoredResult>> parts;
+        for(unsigned i=0; i<readers.size(); i++){
+            if (readers[i]) parts.emplace_back(static_cast<StoredResult*>(readers[i]));
+        }
+        if (!ok || parts.empty()) return 0;
+
+        int nfields = parts[0]->nfields;
+        for(unsigned i=0; i<keyCols.size(); i++){
+            if (keyCols[i] < 0) keyCols[i] = nfields - extra - 1 - keyCols[i];
+        }
+
+        struct RowRef { unsigned part; int row; };
+        std::vector<RowRef> rows;
+        for(unsigned p=0; p<parts.size(); p++){
+            for(int r=0; r<parts[p]->nrows; r++){
+                RowRef ref = { p, r };
+                rows.push_back(ref);
+            }
+        }
+        if (s.m_orderby.size()) {
+            std::stable_sort(rows.begin(), rows.end(), [&](const RowRef& a, const RowRef& b){
+                for(unsigned i=0; i<keyCols.size(); i++){
+                    const StoredResult& x = *parts[a.part];
+                    const StoredResult& y = *parts[b.part];
+                    unsigned ix = a.row*nfields+keyCols[i], iy = b.row*nfields+keyCols[i];
+                    int c = compareFields(keyTypes[i], x.offsets[ix] < 0 ? 0 : x.data.c_str()+x.offsets[ix], x.lengthOf(ix),
+                        y.offsets[iy] < 0 ? 0 : y.data.c_str()+y.offsets[iy], y.lengthOf(iy));
+                    if (c) return s.m_orderby[i].type==OrderAsc ? c<0 : c>0;
+                }
+                return false;
+            });
+        }
+
+        size_t begin = std::min(rows.size(), size_t(s.m_offset));
+        size_t end = s.m_limit ? std::min(rows.size(), begin+s.m_limit) : rows.size();
+        StoredResult* ret = new StoredResult;
+        ret->nfields = nfields - extra;
+        for(size_t i=begin; i<end; i++){
+            const StoredResult& p = *parts[rows[i].part];
+            for(int c=0; c<ret->nfields; c++){
+                unsigned idx = rows[i].row*nfields+c;
+                ret->addField(p.offsets[idx] < 0 ? 0 : p.data.c_str()+p.offsets[idx], p.lengthOf(idx));
+            }
+            ret->nrows++;
+        }
+        return ret;
+    }
+
+    bool ShardRouter::execute( const Insert& s )
+    {
+        int keyCol = -1;
+        for(int i=0; i<s.m_numcols; i++){
+            if (s.m_values[i].col==&key) keyCol = i;
+        }
+        if (keyCol < 0) {
+            err = "the insert doesn't set the shard key";
+            return false;
+        }
+        for(unsigned i=0; i<shards.size(); i++){
+            if (const char* e=s.error(shards[i]->dialect())) {
+                err = e;
+                return false;
+            }
+        }
+
+        // rows grouped by shard, one insert each.
+        int n = static_cast<int>(shards.size());
+        std::vector<Insert> inserts(n, s);
+        for(int i=0; i<n; i++){
+            inserts[i].m_values.clear();
+            inserts[i].m_cache.touch();
+        }
+        for(size_t r=0; r<s.m_values.size(); r+=s.m_numcols){
+            const InsertValue& v = s.m_values[r+keyCol];
+            if (v.lit.type==SqlNoType) {
+                err = "the shard key of an insert must be a literal";
+                return false;
+            }
+            Insert& to = inserts[shardOf(v.lit, n)];
+            to.m_values.insert(to.m_values.end(), s.m_values.begin()+r, s.m_values.begin()+r+s.m_numcols);
+        }
+
+        std::vector<int> targets;
+        std::vector<std::string> sqls;
+        for(int i=0; i<n; i++){
+            if (inserts[i].m_values.empty()) continue;
+            targets.push_back(i);
+            sqls.push_back(inserts[i].toSql(shards[i]->dialect()));
+        }
+        return run(targets, sqls, 0);
+    }
+
+    bool ShardRouter::execute( const Update& s )
+    {
+        std::vector<int> targets = route(s.m_where);
+        std::vector<std::string> sqls;
+        for(unsigned i=0; i<targets.size(); i++) sqls.push_back(s.toSql(shards[targets[i]]->dialect()));
+        return run(targets, sqls, 0);
+    }
+
+    bool ShardRouter::execute( const Delete& s )
+    {
+        std::vector<int> targets = route(s.m_where);
+        std::vector<std::string> sqls;
+        for(unsigned i=0; i<targets.size(); i++) sqls.push_back(s.toSql(shards[targets[i]]->dialect()));
+        return run(targets, sqls, 0);
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "SqlUtils.h"
+
+namespace sqlgen
+{
+    // the shard of a key value, from 0 to numShards-1.
+    typedef int (*ShardFunc)(const Literal& key, int numShards);
+
+    // ints modulo the shard count, strings by hash.
+    int hashShard(const Literal& key, int numShards);
+
+    // sends statements over a table split by key across several databases. a statement whose
+    // where clause pins the key(`key = v`, `key IN (...)`, through AND/OR) goes to the shards
+    // holding those values only, the others go to every shard in parallel. merged selects keep
+    // their ORDER BY(compared as the sql type of each key), LIMIT and OFFSET. aggregates,
+    // DISTINCT, GROUP BY and HAVING can't be merged, such selects must pin a single shard.
+    struct ShardRouter
+    {
+        std::vector<SqlConnection*> shards;
+        const Field&                key;
+        ShardFunc                   shardOf;
+        std::string                 err;
+
+        ShardRouter(const std::vector<SqlConnection*>& shards_, const Field& key_, ShardFunc f=hashShard);
+
+        // the shards a where clause can match, all of them when it doesn't pin the key.
+        std::vector<int>    route(const Exp* where)const;
+
+        // the result is owned by the caller, null on error.
+        SqlResultReader*    select(const Select& s);
+        bool                execute(const Insert& s);
+        bool                execute(const Update& s);
+        bool                execute(const Delete& s);
+        const char*         error()const{return err.c_str();}
+
+    private:
+        ShardRouter& operator=(const ShardRouter&);
+        bool    run(const std::vector<int>& targets, const std::vector<std::string>& sqls, std::vector<SqlResultReader*>* results);
+    };
+
+    template<typename Func>
+    void query(ShardRouter& r, const Select& s, Func f)
+    {
+        std::unique_ptr<SqlResultReader> res(r.select(s));
+        if (res) unpackResultValues(*res, f);
+    }
+}
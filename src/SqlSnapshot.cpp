@@ -0,0 +1,168 @@
+#include "stdafx.h"
+#include "SqlSnapshot.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace sqlgen{
+
+    static const char snapshotMagic[8] = {'S','Q','L','S','N','A','P','1'};
+
+    // the data must be on the disk before the rename makes it the snapshot.
+    static bool syncFile( FILE* f )
+    {
+        if (fflush(f)) return false;
+#ifdef _WIN32
+        return _commit(_fileno(f))==0;
+#else
+        return fsync(fileno(f))==0;
+#endif
+    }
+
+    static bool replaceFile( const char* from, const char* to )
+    {
+#ifdef _WIN32
+        return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING)!=0;
+#else
+        return rename(from, to)==0;
+#endif
+    }
+
+    bool saveSnapshot( SqlResultReader& r, const char* path )
+    {
+        size_t n = size_t(r.nrows)*r.nfields;
+        std::vector<SnapshotField> fields(n);
+        std::string arena;
+        for(int row=0; row<r.nrows; row++){
+            for(int col=0; col<r.nfields; col++){
+                SnapshotField& f = fields[size_t(col)*r.nrows+row];
+                const char* p = r.nextField();
+                f.offset = arena.size();
+                f.isNull = !p;
+                f.length = p ? static_cast<unsigned>(r.fieldLength()) : 0;
+                if (p) arena.append(p, f.length);
+                arena.push_back(0);
+            }
+        }
+
+        SnapshotHeader h;
+        memcpy(h.magic, snapshotMagic, sizeof(h.magic));
+        h.nrows = r.nrows;
+        h.nfields = r.nfields;
+        h.arena = sizeof(h) + n*sizeof(SnapshotField);
+
+        // written aside then renamed over path, readers never map a partial file.
+        std::string tmp = std::string(path) + ".tmp";
+        FILE* file = fopen(tmp.c_str(), "wb");
+        if (!file) return false;
+        bool ok = fwrite(&h, sizeof(h), 1, file)==1
+            && fwrite(fields.data(), sizeof(SnapshotField), n, file)==n
+            && fwrite(arena.data(), 1, arena.size(), file)==arena.size()
+            && syncFile(file);
+        ok = fclose(file)==0 && ok && replaceFile(tmp.c_str(), path);
+        if (!ok) remove(tmp.c_str());
+        return ok;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    Snapshot::Snapshot():nrows(0),nfields(0),fields(0),arena(0),base(0),size(0)
+#ifdef _WIN32
+        ,file(INVALID_HANDLE_VALUE),mapping(0)
+#endif
+    {
+    }
+
+    Snapshot::~Snapshot()
+    {
+        close();
+    }
+
+    bool Snapshot::open( const char* path )
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER len;
+        if (!GetFileSizeEx(file, &len) || !len.QuadPart) { close(); return false; }
+        size = static_cast<size_t>(len.QuadPart);
+        mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+        base = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+        if (!base) { close(); return false; }
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) || !st.st_size) { ::close(fd); return false; }
+        size = static_cast<size_t>(st.st_size);
+        base = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) { base = 0; return false; }
+#endif
+
+        const SnapshotHeader* h = static_cast<const SnapshotHeader*>(base);
+        if (size < sizeof(SnapshotHeader) || memcmp(h->magic, snapshotMagic, sizeof(h->magic))
+            || h->arena != sizeof(SnapshotHeader) + (unsigned long long)h->nrows*h->nfields*sizeof(SnapshotField) 
+            || h->arena > size || h->nrows > 0x7fffffff || h->nfields > 0x7fffffff) {
+            close();
+            return false;
+        }
+        nrows = h->nrows;
+        nfields = h->nfields;
+        fields = reinterpret_cast<const SnapshotField*>(h+1);
+        arena = static_cast<const char*>(base) + h->arena;
+
+        // every field and its terminating 0 must be inside the arena.
+        unsigned long long arenaSize = size - h->arena;
+        for(size_t i=0, n=size_t(nrows)*nfields; i<n; i++){
+            const SnapshotField& f = fields[i];
+            if (f.isNull) continue;
+            if (f.offset >= arenaSize || f.length >= arenaSize - f.offset || arena[f.offset+f.length]) {
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Snapshot::close()
+    {
+#ifdef _WIN32
+        if (base) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = 0;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base) munmap(base, size);
+#endif
+        base = 0;
+        size = 0;
+        nrows = nfields = 0;
+        fields = 0;
+        arena = 0;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    const char* SnapshotReader::nextField()
+    {
+        const char* f = snap.field(row, col);
+        if (++col == nfields) {
+            col = 0;
+            row++;
+        }
+        return f;
+    }
+}
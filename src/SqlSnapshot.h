@@ -0,0 +1,92 @@
+#pragma once
+#include "SqlUtils.h"
+
+namespace sqlgen
+{
+    // a result saved to a file column by column, so other processes can map it read only
+    // instead of fetching it again. layout: a header, then for each column nrows field
+    // entries, then the arena holding each non NULL field followed by a 0.
+    struct SnapshotHeader
+    {
+        char                magic[8];
+        unsigned            nrows, nfields;
+        unsigned long long  arena;      // file offset of the arena.
+    };
+
+    struct SnapshotField
+    {
+        unsigned long long  offset;     // in the arena.
+        unsigned            length;
+        int                 isNull;
+    };
+
+    // reads the whole result, it's left at its end. written to path.tmp then renamed
+    // over path, so readers see the old snapshot or the new one, never a partial file.
+    bool saveSnapshot(SqlResultReader& r, const char* path);
+
+    struct Snapshot
+    {
+        int                     nrows, nfields;
+        const SnapshotField*    fields;
+        const char*             arena;
+
+        Snapshot();
+        ~Snapshot();
+        // false unless path is a whole snapshot with every field inside the file.
+        bool        open(const char* path);
+        void        close();
+
+        // points into the mapping, valid until close(). null for NULL.
+        const char* field(int row, int col)const
+        {
+            const SnapshotField& f = fields[size_t(col)*nrows+row];
+            return f.isNull ? 0 : arena+f.offset;
+        }
+        size_t      length(int row, int col)const{ return fields[size_t(col)*nrows+row].length; }
+
+        // any SqlType<T>, Blob included.
+        template<typename T>
+        T           get(int row, int col)const{ return SqlType<T>::fromField(field(row, col)); }
+
+        // decoded like a fresh result: snapshot.query([](const vector<Users::Row>& all){}).
+        template<typename Func>
+        void        query(Func f)const;
+
+    private:
+        Snapshot(const Snapshot&);
+        Snapshot& operator=(const Snapshot&);
+
+        void*       base;
+        size_t      size;
+#ifdef _WIN32
+        void*       file;
+        void*       mapping;
+#endif
+    };
+
+    // the rows of a snapshot in order, for SqlType<> decoding.
+    struct SnapshotReader : SqlResultReader
+    {
+        const Snapshot& snap;
+        int             row, col;
+
+        explicit SnapshotReader(const Snapshot& s):snap(s),row(0),col(0){ nrows=s.nrows; nfields=s.nfields; }
+        const char* nextField();
+        void        nextRow(){}
+        size_t      fieldLength(){ return col ? snap.length(row, col-1) : snap.length(row-1, nfields-1); }
+    };
+
+    // a blob may hold zeros, it's read with its length.
+    template<>
+    inline Blob Snapshot::get<Blob>(int row, int col) const
+    {
+        return SqlType<Blob>::fromField(field(row, col), length(row, col));
+    }
+
+    template<typename Func>
+    void Snapshot::query(Func f) const
+    {
+        SnapshotReader r(*this);
+        unpackResultValues(r, f);
+    }
+}
@@ -0,0 +1,144 @@
+#include "stdafx.h"
+#include "SqlTransaction.h"
+#include "SqlCache.h"
+
+
+namespace sqlgen{
+
+    Transaction::Transaction( SqlConnection& c ) :con(c),depth(0),began(false),done(false)
+    {
+        begin();
+    }
+
+    Transaction::Transaction() :con(*getConnection()),depth(0),began(false),done(false)
+    {
+        begin();
+    }
+
+    Transaction::~Transaction()
+    {
+        if (!done) rollback();
+    }
+
+    void Transaction::begin()
+    {
+        depth = con.transactionDepth();
+        if (depth) began = execute(con, "SAVEPOINT sp" + std::to_string(depth));
+        else began = execute(con, "BEGIN");
+        // there's nothing to end.
+        if (!began) done = true;
+        else con.transactionDepth()++;
+    }
+
+    bool Transaction::end( const char* sql, const char* savepointSql )
+    {
+        if (!depth) return execute(con, sql);
+        return execute(con, savepointSql + std::to_string(depth));
+    }
+
+    void Transaction::close()
+    {
+        done = true;
+        con.transactionDepth()--;
+    }
+
+    bool Transaction::commit()
+    {
+        if (done || !end("COMMIT", "RELEASE SAVEPOINT sp")) return false;
+        close();
+        // other connections may have cached the rows from before the commit.
+        std::vector<std::string>& written = con.transactionWrites();
+        if (!depth) {
+            ResultCache* rc = getResultCache();
+            for(unsigned i=0; rc && i<written.size(); i++) rc->invalidate(written[i]);
+            written.clear();
+        }
+        return true;
+    }
+
+    bool Transaction::rollback()
+    {
+        if (done) return false;
+        bool ok = end("ROLLBACK", "ROLLBACK TO SAVEPOINT sp");
+        close();
+        if (!depth) con.transactionWrites().clear();
+        // both mysql and sqlite keep the savepoint after rolling back to it.
+        if (ok && depth) execute(con, "RELEASE SAVEPOINT sp" + std::to_string(depth));
+        return ok;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    GroupCommit::GroupCommit( SqlConnection& c, int maxStatements_, int maxDelayMs ) 
+        :con(c),maxStatements(maxStatements_),maxDelay(std::chrono::milliseconds(maxDelayMs)),tx(0),pending(0),commits(0)
+    {
+    }
+
+    GroupCommit::~GroupCommit()
+    {
+        flush();
+    }
+
+    bool GroupCommit::open()
+    {
+        if (tx) return true;
+        tx = new Transaction(con);
+        if (!tx->began) {
+            delete tx;
+            tx = 0;
+            return false;
+        }
+        started = Clock::now();
+        return true;
+    }
+
+    bool GroupCommit::added( bool ok )
+    {
+        pending++;
+        if (pending >= maxStatements) return flush() && ok;
+        return poll() && ok;
+    }
+
+    bool GroupCommit::add( const std::string& sql )
+    {
+        if (!open()) return false;
+        return added(execute(con, sql));
+    }
+
+    bool GroupCommit::add( const Insert& s )
+    {
+        if (!open()) return false;
+        return added(execute(con, s));
+    }
+
+    bool GroupCommit::add( const Update& s )
+    {
+        if (!open()) return false;
+        return added(execute(con, s));
+    }
+
+    bool GroupCommit::add( const Delete& s )
+    {
+        if (!open()) return false;
+        return added(execute(con, s));
+    }
+
+    bool GroupCommit::poll()
+    {
+        if (tx && Clock::now() - started >= maxDelay) return flush();
+        return true;
+    }
+
+    bool GroupCommit::flush()
+    {
+        if (!tx) return true;
+        bool ok = tx->commit();
+        // rolls back a failed commit.
+        delete tx;
+        tx = 0;
+        pending = 0;
+        if (ok) commits++;
+        return ok;
+    }
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <chrono>
+#include "SqlUtils.h"
+
+namespace sqlgen
+{
+    // BEGIN when built, ROLLBACK when destroyed without commit().
+    // a transaction opened inside another one on the same connection is a savepoint.
+    // a failed commit() leaves it open, to be retried or rolled back.
+    struct Transaction
+    {
+        SqlConnection&  con;
+        int             depth;      // 0 for the outermost transaction.
+        bool            began;      // false when BEGIN failed, don't write in it then.
+        bool            done;
+
+        explicit Transaction(SqlConnection& c);
+        Transaction();
+        ~Transaction();
+        bool    commit();
+        bool    rollback();
+
+    private:
+        Transaction(const Transaction&);
+        Transaction& operator=(const Transaction&);
+        void    begin();
+        bool    end(const char* sql, const char* savepointSql);
+        void    close();
+    };
+
+    // runs writes inside a transaction committed every maxStatements statements, or 
+    // once maxDelayMs have passed since its first statement, trading durability of the 
+    // last few writes for one sync per batch. not thread safe, call poll() when idle 
+    // to honor the delay without new writes.
+    struct GroupCommit
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        SqlConnection&          con;
+        int                     maxStatements;
+        Clock::duration         maxDelay;
+        Transaction*            tx;
+        int                     pending;
+        Clock::time_point       started;
+        int                     commits;    // successful ones.
+
+        GroupCommit(SqlConnection& c, int maxStatements_, int maxDelayMs);
+        ~GroupCommit();
+        bool    add(const std::string& sql);
+        bool    add(const Insert& s);
+        bool    add(const Update& s);
+        bool    add(const Delete& s);
+        bool    poll();
+        bool    flush();
+
+    private:
+        GroupCommit(const GroupCommit&);
+        GroupCommit& operator=(const GroupCommit&);
+        bool    open();
+        bool    added(bool ok);
+    };
+}
@@ -0,0 +1,230 @@
+#ifndef SQLGEN_TYPED_HPP
+#define SQLGEN_TYPED_HPP
+
+#include <type_traits>
+#include "SqlGen.h"
+
+namespace sqlgen
+{
+    // fields, literals and expressions carrying their c++ type, so that mismatched operands,
+    // `like` on a non string, a non bool `where` or a comparison given to set() don't compile.
+    // they mix with untyped ones, which are still checked by sqlAssert in debug builds:
+    //     TField<int> age(this, "age");
+    //     Select().from(u).where(age > 18 && name.like("a%"));     // ok
+    //     age == "18";  age.like("1%");  Update().set(age == 1);  // compile errors
+
+    template<typename T> struct SqlTypeOf;
+    template<> struct SqlTypeOf<int>        { enum { value=SqlInt }; };
+    template<> struct SqlTypeOf<long long>  { enum { value=SqlInt64 }; };
+    // int64_t is long on LP64, unsigned ints may not fit a signed int.
+    template<> struct SqlTypeOf<long>       { enum { value=SqlInt64 }; };
+    template<> struct SqlTypeOf<unsigned>   { enum { value=SqlInt64 }; };
+    template<> struct SqlTypeOf<unsigned long>      { enum { value=SqlInt64 }; };
+    template<> struct SqlTypeOf<unsigned long long> { enum { value=SqlInt64 }; };
+    template<> struct SqlTypeOf<bool>       { enum { value=SqlBool }; };
+    template<> struct SqlTypeOf<float>      { enum { value=SqlFloat }; };
+    template<> struct SqlTypeOf<double>     { enum { value=SqlDouble }; };
+    template<> struct SqlTypeOf<string>     { enum { value=SqlString }; };
+    template<> struct SqlTypeOf<DateTime>   { enum { value=SqlDateTime }; };
+    template<> struct SqlTypeOf<Blob>       { enum { value=SqlBlob }; };
+
+    template<typename T>
+    struct SqlIsNumber : std::integral_constant<bool, std::is_arithmetic<T>::value && !std::is_same<T, bool>::value> {};
+
+    // whether T and V operands can meet, numbers mix like they do at run time.
+    template<typename T, typename V>
+    struct SqlComparable : std::integral_constant<bool, std::is_same<T, V>::value
+        || (SqlIsNumber<T>::value && SqlIsNumber<V>::value)
+        || (std::is_same<T, string>::value && std::is_convertible<const V&, const char*>::value)> {};
+
+    // a literal only built from values comparable to T, it keeps their own type:
+    // an int field against 1.5 renders 1.5.
+    template<typename T>
+    struct TLiteral : Literal
+    {
+        template<typename V>
+        TLiteral(const V& v, typename std::enable_if<SqlComparable<T, V>::value>::type* =0):Literal(v){}
+    };
+
+    template<typename T>
+    struct TBinExp : BinExp
+    {
+        TBinExp(OpType t, const Exp& l, const Exp& r):BinExp(t, l, r){}
+    };
+
+    // the only expression set() and values() take.
+    struct TAssign : BinExp
+    {
+        TAssign(const Exp& l, const Exp& r):BinExp(Assign, l, r){}
+    };
+
+    template<typename T>
+    struct TField : Field
+    {
+        typedef TLiteral<T> Lit;
+
+        TField(Table* tb, const string& name_):Field(tb, SqlPrimaryType(SqlTypeOf<T>::value), name_){}
+
+        TAssign         operator=(const Lit& l){return TAssign(*this, l);}
+        TAssign         operator=(const TField& e){return TAssign(*this, e);}
+        template<typename U>
+        TAssign         operator=(const TField<U>& e)
+        {
+            static_assert(SqlComparable<T, U>::value, "assigned field has another type");
+            return TAssign(*this, e);
+        }
+        template<typename U>
+        TAssign         operator=(const TBinExp<U>& e)
+        {
+            static_assert(SqlComparable<T, U>::value, "assigned expression has another type");
+            return TAssign(*this, e);
+        }
+        TBinExp<bool>   like(const TLiteral<string>& s)const
+        {
+            static_assert(std::is_same<T, string>::value, "`like` needs a string field");
+            return TBinExp<bool>(BinExp::Like, *this, s);
+        }
+    };
+
+    // result type of a typed operator, checking its operands.
+    template<int Op, typename T, typename U>
+    struct TOp
+    {
+        enum { logic = Op==BinExp::And || Op==BinExp::Or };
+        enum { compare = !logic && Op<=BinExp::LogicOpLast };
+        static_assert(!logic || (std::is_same<T, bool>::value && std::is_same<U, bool>::value), "`&&` and `||` need bool operands");
+        static_assert(!compare || SqlComparable<T, U>::value, "compared operands have different types");
+        static_assert(logic || compare || (SqlIsNumber<T>::value && SqlIsNumber<U>::value), "arithmetic needs number operands");
+        typedef TBinExp<typename std::conditional<logic || compare, bool, T>::type> Result;
+    };
+
+    // a value which is neither an expression nor comparable to T.
+    template<typename T, typename V>
+    struct TMismatch : std::enable_if<!std::is_base_of<Exp, V>::value && !std::is_convertible<const V&, TLiteral<T> >::value, TBinExp<bool> > {};
+
+    template<typename V> struct TFalse : std::false_type {};
+
+    template<typename T> inline Select& Select::where(const TBinExp<T>& c)
+    {
+        static_assert(std::is_same<T, bool>::value, "`where` needs a bool expression");
+        m_where = &c;
+        m_cache.touch(ClauseWhere);
+        return *this;
+    }
+
+    template<typename T> inline Select& Select::having(const TBinExp<T>& c)
+    {
+        static_assert(std::is_same<T, bool>::value, "`having` needs a bool expression");
+        m_having = &c;
+        m_cache.touch(ClauseHaving);
+        return *this;
+    }
+
+    template<typename T> inline Update& Update::set(const TBinExp<T>& v)
+    {
+        static_assert(TFalse<T>::value, "`set` needs an assignment: field = value");
+        return *this;
+    }
+
+    template<typename T> inline Update& Update::where(const TBinExp<T>& v)
+    {
+        static_assert(std::is_same<T, bool>::value, "`where` needs a bool expression");
+        m_where = &v;
+        m_cache.touch(ClauseWhere);
+        return *this;
+    }
+
+    template<typename T> inline Delete& Delete::where(const TBinExp<T>& e)
+    {
+        static_assert(std::is_same<T, bool>::value, "`where` needs a bool expression");
+        m_where = &e;
+        m_cache.touch(ClauseWhere);
+        return *this;
+    }
+
+    // typed operands match these exactly, so they win over the untyped operators.
+#define SQLGEN_TYPED_OP(L, R) \
+    template<typename T, typename U> inline const typename TOp<BinExp::TYPE, T, U>::Result operator OP (const L<T>& l, const R<U>& r) \
+    { return typename TOp<BinExp::TYPE, T, U>::Result(BinExp::TYPE, l, r); }
+
+#define SQLGEN_TYPED_LITERAL_OP(L) \
+    template<typename T> inline const typename TOp<BinExp::TYPE, T, T>::Result operator OP (const L<T>& l, const typename TField<T>::Lit& r) \
+    { return typename TOp<BinExp::TYPE, T, T>::Result(BinExp::TYPE, l, r); } \
+    template<typename T> inline const typename TOp<BinExp::TYPE, T, T>::Result operator OP (const typename TField<T>::Lit& l, const L<T>& r) \
+    { return typename TOp<BinExp::TYPE, T, T>::Result(BinExp::TYPE, l, r); } \
+    template<typename T, typename V> inline typename TMismatch<T, V>::type operator OP (const L<T>& l, const V& r) \
+    { static_assert(TFalse<V>::value, "value type doesn't match the operand type"); return typename TMismatch<T, V>::type(BinExp::TYPE, l, l); } \
+    template<typename T, typename V> inline typename TMismatch<T, V>::type operator OP (const V& l, const L<T>& r) \
+    { static_assert(TFalse<V>::value, "value type doesn't match the operand type"); return typename TMismatch<T, V>::type(BinExp::TYPE, r, r); }
+
+#define OP +
+#define TYPE Add
+#include "SqlTyped.h"
+
+#define OP -
+#define TYPE Sub
+#include "SqlTyped.h"
+
+#define OP *
+#define TYPE Mul
+#include "SqlTyped.h"
+
+#define OP /
+#define TYPE Div
+#include "SqlTyped.h"
+
+#define OP %
+#define TYPE Mod
+#include "SqlTyped.h"
+
+#define OP &&
+#define TYPE And
+#include "SqlTyped.h"
+
+#define OP ||
+#define TYPE Or
+#include "SqlTyped.h"
+
+#define OP >
+#define TYPE LargerThan
+#include "SqlTyped.h"
+
+#define OP <
+#define TYPE LessThan
+#include "SqlTyped.h"
+
+#define OP ==
+#define TYPE Equ
+#include "SqlTyped.h"
+
+#define OP <=
+#define TYPE LessEqu
+#include "SqlTyped.h"
+
+#define OP >=
+#define TYPE LargerEqu
+#include "SqlTyped.h"
+
+#define OP !=
+#define TYPE NotEqu
+#include "SqlTyped.h"
+
+#undef SQLGEN_TYPED_OP
+#undef SQLGEN_TYPED_LITERAL_OP
+}
+
+#pragma once
+
+#else
+
+    SQLGEN_TYPED_OP(TField, TField)
+    SQLGEN_TYPED_OP(TField, TBinExp)
+    SQLGEN_TYPED_OP(TBinExp, TField)
+    SQLGEN_TYPED_OP(TBinExp, TBinExp)
+    SQLGEN_TYPED_LITERAL_OP(TField)
+    SQLGEN_TYPED_LITERAL_OP(TBinExp)
+
+#undef OP
+#undef TYPE
+
+#endif
@@ -1,14 +1,164 @@
 #include "stdafx.h"
 #include "SqlUtils.h"
+#include "SqlCache.h"
 
 
 namespace sqlgen{
 
+    static size_t inListChunkSize = 1000;
+
+    void setInListChunkSize( size_t n )
+    {
+        inListChunkSize = n;
+    }
+
+    size_t getInListChunkSize()
+    {
+        return inListChunkSize;
+    }
+
+    static SqlConnection* defaultConnection = 0;
+
+    void setConnection( SqlConnection* c )
+    {
+        defaultConnection = c;
+    }
+
+    SqlConnection* getConnection()
+    {
+        return defaultConnection;
+    }
+
+    bool execute( SqlConnection& c, const std::string& ss )
+    {
+        delete c.execute(ss.c_str());
+        return !*c.error();
+    }
+
+    static bool executeWrite( SqlConnection& c, const std::string& ss, const Table* t )
+    {
+        bool ok = execute(c, ss);
+        if (ResultCache* rc = getResultCache()) {
+            rc->invalidate(t->m_tableName);
+            // other connections can cache the old rows until the transaction commits.
+            if (c.transactionDepth()) c.transactionWrites().push_back(t->m_tableName);
+        }
+        return ok;
+    }
+
+    bool execute( SqlConnection& c, const Insert& s )
+    {
+        if (s.error(c.dialect())) return false;
+        return executeWrite(c, s.toSql(c.dialect()), s.m_table);
+    }
+
+    bool execute( SqlConnection& c, const Update& s )
+    {
+        return executeWrite(c, s.toSql(c.dialect()), s.m_table);
+    }
+
+    bool execute( SqlConnection& c, const Delete& s )
+    {
+        return executeWrite(c, s.toSql(c.dialect()), s.m_table);
+    }
+
+    SqlResultReader* executeSelect( SqlConnection& c, const Select& s )
+    {
+        std::vector<std::string> sqls;
+        s.toSqlChunks(getInListChunkSize(), sqls, c.dialect());
+        if (sqls.size()==1) return executeSelect(c, sqls[0], s);
+
+        MultiResultReader* r = new MultiResultReader;
+        for(unsigned i=0; i<sqls.size(); i++){
+            SqlResultReader* part=executeSelect(c, sqls[i], s);
+            // the rows of the other chunks alone would pass for the whole result.
+            if (!part && *c.error()) {
+                delete r;
+                return 0;
+            }
+            if (part) r->add(part);
+        }
+        if (r->parts.empty()) {
+            delete r;
+            return 0;
+        }
+        return r;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    void StoredResult::addField( const char* f, size_t len )
+    {
+        if (!f) {
+            offsets.push_back(-1);
+            return;
+        }
+        offsets.push_back(static_cast<int>(data.size()));
+        data.append(f, len);
+        data.push_back(0);
+    }
+
+    const char* StoredResult::nextField()
+    {
+        int off = offsets[cur++];
+        return off < 0 ? 0 : data.c_str()+off;
+    }
+
+    size_t StoredResult::lengthOf( unsigned i ) const
+    {
+        if (offsets[i] < 0) return 0;
+        // ends at the next non NULL field, each field is followed by a 0.
+        for(unsigned j=i+1; j<offsets.size(); j++){
+            if (offsets[j] >= 0) return offsets[j]-offsets[i]-1;
+        }
+        return data.size()-offsets[i]-1;
+    }
+
+    StoredResult* storeResult( SqlResultReader* r )
+    {
+        if (StoredResult* s = dynamic_cast<StoredResult*>(r)) return s;
+
+        StoredResult* s = new StoredResult;
+        s->nrows = r->nrows;
+        s->nfields = r->nfields;
+        for(int i=0, n=r->nrows*r->nfields; i<n; i++){
+            const char* f = r->nextField();
+            s->addField(f, f ? r->fieldLength() : 0);
+        }
+        delete r;
+        return s;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+    void MultiResultReader::add( SqlResultReader* r )
+    {
+        parts.emplace_back(r);
+        nrows += r->nrows;
+        nfields = r->nfields;
+        if (parts.size()==1) fieldsLeft = r->nrows*r->nfields;
+    }
+
+    const char* MultiResultReader::nextField()
+    {
+        while (!fieldsLeft && curPart+1 < parts.size()) {
+            curPart++;
+            fieldsLeft = parts[curPart]->nrows*parts[curPart]->nfields;
+        }
+        fieldsLeft--;
+        return parts[curPart]->nextField();
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+
+
+#ifdef SQLGEN_MYSQL
 
     const char* MysqlResultReader::nextField()
     {
         if (!current) nextRow(); 
         const char* f = current[curField];
+        lastLength = mysql_fetch_lengths(result)[curField];
         curField++;
         if (curField >= nfields) {
             curField = 0;
@@ -39,4 +189,70 @@ namespace sqlgen{
         if (result) mysql_free_result(result);
     }
 
+    SqlResultReader* MysqlConnection::execute( const char* sql )
+    {
+        if (mysql_query(con, sql)) return 0;
+        MysqlResultReader* r = new MysqlResultReader;
+        if (!r->init(con)) {
+            delete r;
+            return 0;
+        }
+        return r;
+    }
+
+    const char* MysqlConnection::error()
+    {
+        return mysql_error(con);
+    }
+
+    void MysqlConnection::cancel()
+    {
+        if (!killCon) return;
+        std::string sql = "KILL QUERY " + std::to_string(mysql_thread_id(con));
+        mysql_query(killCon, sql.c_str());
+    }
+
+#endif
+
+#ifdef SQLGEN_SQLITE
+
+    SqlResultReader* SqliteConnection::execute( const char* sql )
+    {
+        err.clear();
+        StoredResult* r = 0;
+        while (sql && *sql) {
+            sqlite3_stmt* stmt = 0;
+            if (sqlite3_prepare_v2(db, sql, -1, &stmt, &sql) != SQLITE_OK) {
+                err = sqlite3_errmsg(db);
+                break;
+            }
+            if (!stmt) break; // trailing whitespace or comment.
+
+            int ncol = sqlite3_column_count(stmt);
+            if (ncol) {
+                delete r;
+                r = new StoredResult;
+                r->nfields = ncol;
+            }
+            int rc;
+            while ((rc=sqlite3_step(stmt)) == SQLITE_ROW) {
+                for(int i=0; i<ncol; i++){
+                    const char* f = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+                    r->addField(f, sqlite3_column_bytes(stmt, i));
+                }
+                r->nrows++;
+            }
+            if (rc != SQLITE_DONE) err = sqlite3_errmsg(db);
+            sqlite3_finalize(stmt);
+            if (!err.empty()) break;
+        }
+        if (!err.empty()) {
+            delete r;
+            return 0;
+        }
+        return r;
+    }
+
+#endif
+
 }
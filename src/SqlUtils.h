@@ -2,26 +2,108 @@
 #include <vector>
 #include <string>
 #include <stdlib.h>//atoi
-#include <functional>
+#include <string.h>//strlen
+#include <memory>
+#include <tuple>
+#include "SqlGen.h"
 
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define SQLGEN_OPTIONAL
+#include <optional>
+#endif
 
-#define SQLGEN_MYSQL
-
+// the backend is chosen by the build: SQLGEN_MYSQL, SQLGEN_SQLITE or none of them for
+// connections of your own, see CMakeLists.txt.
 #ifdef SQLGEN_MYSQL
+#ifdef _MSC_VER
 #include <my_global.h>
-#include <mysql.h>
 #pragma comment(lib, "mysqlclient.lib")
 #endif
+#include <mysql.h>
+#endif
+
+#ifdef SQLGEN_SQLITE
+#include <sqlite3.h>
+#endif
 
 namespace sqlgen
 {
     struct SqlResultReader
     {
         int nrows, nfields;
+        virtual ~SqlResultReader(){}
         virtual const char* nextField() = 0;
         virtual void nextRow() = 0;
+        // bytes of the field nextField() returned last, binary fields may hold NULs.
+        virtual size_t fieldLength() = 0;
+    };
+
+    // reads several results with the same columns as one, e.g. the chunks of a big `IN` query.
+    struct MultiResultReader : SqlResultReader
+    {
+        std::vector<std::unique_ptr<SqlResultReader>> parts;
+        unsigned    curPart;
+        int         fieldsLeft;
+
+        MultiResultReader():curPart(0),fieldsLeft(0){ nrows=nfields=0; }
+        void        add(SqlResultReader* r);
+        const char* nextField();
+        void        nextRow(){}
+        size_t      fieldLength(){ return parts[curPart]->fieldLength(); }
+    };
+
+    // a result fully copied out of the driver: all fields in one buffer.
+    struct StoredResult : SqlResultReader
+    {
+        std::string         data;
+        std::vector<int>    offsets;    // -1 for NULL.
+        unsigned            cur;
+
+        StoredResult():cur(0){ nrows=nfields=0; }
+        void        addField(const char* f, size_t len);
+        const char* nextField();
+        void        nextRow(){}
+        size_t      fieldLength(){ return lengthOf(cur-1); }
+        size_t      lengthOf(unsigned i)const;
+    };
+
+    // copies a result out of the driver, the reader is consumed.
+    StoredResult*   storeResult(SqlResultReader* r);
+
+    // max keys of an `IN` list rendered in one statement, bigger lists are split by query().
+    void    setInListChunkSize(size_t n);
+    size_t  getInListChunkSize();
+
+    //////////////////////////////////////////////////////////////////////////
+
+    struct SqlConnection
+    {
+        int txDepth;    // open transactions and savepoints, see SqlTransaction.h.
+        std::vector<std::string> txWrites;  // tables written by the open transaction, invalidated in the result cache on commit.
+
+        SqlConnection():txDepth(0){}
+        virtual ~SqlConnection(){}
+        virtual SqlDialect          dialect()const = 0;
+        // run one statement, return its result set(owned by the caller) or null if 
+        // it has none or failed, see error().
+        virtual SqlResultReader*    execute(const char* sql) = 0;
+        virtual const char*         error() = 0;
+        // abort the statement running on this connection, callable from any thread.
+        virtual void                cancel(){}
+        // the txDepth of the connection statements end up on, a wrapper returns its target's.
+        virtual int&                transactionDepth(){ return txDepth; }
+        virtual std::vector<std::string>& transactionWrites(){ return txWrites; }
     };
 
+    // the connection used by query()/execute() when none is given.
+    void            setConnection(SqlConnection* c);
+    SqlConnection*  getConnection();
+
+    // results of query(Select) are cached when set, see SqlCache.h.
+    struct ResultCache;
+    void            setResultCache(ResultCache* c);
+    ResultCache*    getResultCache();
+
     //////////////////////////////////////////////////////////////////////////
 
     template<typename T>
@@ -41,16 +123,216 @@ namespace sqlgen
     template<typename T>
     struct SqlType<const T&> : SqlType<T> {};
 
+    // scalars decode from one field with fromField(), a NULL field gives the zero value.
+
     template<>
     struct SqlType<int>
     {        
-        static int fromSql(SqlResultReader& r){ return atoi(r.nextField()); }
+        static int fromField(const char* f){ return f ? atoi(f) : 0; }
+        static int fromSql(SqlResultReader& r){ return fromField(r.nextField()); }
+    };
+
+    template<>
+    struct SqlType<float>
+    {        
+        static float fromField(const char* f){ return f ? static_cast<float>(atof(f)) : 0; }
+        static float fromSql(SqlResultReader& r){ return fromField(r.nextField()); }
     };
 
     template<>
     struct SqlType<std::string>
     {
-        static std::string fromSql(SqlResultReader& r){ return r.nextField(); }
+        static std::string fromField(const char* f){ return f ? f : std::string(); }
+        static std::string fromSql(SqlResultReader& r){ return fromField(r.nextField()); }
+    };
+
+    inline long long parseInt64(const char* f)
+    {
+        bool neg = *f=='-';
+        if (neg || *f=='+') f++;
+        unsigned long long v = 0;
+        for(; unsigned(*f-'0') < 10; f++) v = v*10 + unsigned(*f-'0');
+        return neg ? static_cast<long long>(0ull-v) : static_cast<long long>(v);
+    }
+
+    template<>
+    struct SqlType<long long>
+    {
+        static long long fromField(const char* f){ return f ? parseInt64(f) : 0; }
+        static long long fromSql(SqlResultReader& r){ return fromField(r.nextField()); }
+    };
+
+    // int64_t is long on LP64.
+    template<>
+    struct SqlType<long>
+    {
+        static long fromField(const char* f){ return f ? static_cast<long>(parseInt64(f)) : 0; }
+        static long fromSql(SqlResultReader& r){ return fromField(r.nextField()); }
+    };
+
+    template<>
+    struct SqlType<unsigned>
+    {
+        static unsigned fromField(const char* f){ return f ? static_cast<unsigned>(parseInt64(f)) : 0; }
+        static unsigned fromSql(SqlResultReader& r){ return fromField(r.nextField()); }
+    };
+
+    // parseInt64 keeps the bits of values above LLONG_MAX.
+    template<>
+    struct SqlType<unsigned long long>
+    {
+        static unsigned long long fromField(const char* f){ return f ? static_cast<unsigned long long>(parseInt64(f)) : 0; }
+        static unsigned long long fromSql(SqlResultReader& r){ return fromField(r.nextField()); }
+    };
+
+    template<>
+    struct SqlType<unsigned long>
+    {
+        static unsigned long fromField(const char* f){ return f ? static_cast<unsigned long>(parseInt64(f)) : 0; }
+        static unsigned long fromSql(SqlResultReader& r){ return fromField(r.nextField()); }
+    };
+
+    template<>
+    struct SqlType<double>
+    {
+        static double fromField(const char* f){ return f ? strtod(f, 0) : 0; }
+        static double fromSql(SqlResultReader& r){ return fromField(r.nextField()); }
+    };
+
+    // mysql and sqlite give 0/1, postgres t/f.
+    template<>
+    struct SqlType<bool>
+    {
+        static bool fromField(const char* f){ return f && (*f=='1' || *f=='t' || *f=='T'); }
+        static bool fromSql(SqlResultReader& r){ return fromField(r.nextField()); }
+    };
+
+    // `YYYY-MM-DD[ HH:MM:SS]`, a 'T' separator and trailing fractions or zones are accepted.
+    template<>
+    struct SqlType<DateTime>
+    {
+        static int digits(const char* p, int n)
+        {
+            int v = 0;
+            for(int i=0; i<n; i++) v = v*10 + (p[i]-'0');
+            return v;
+        }
+        static DateTime fromField(const char* f)
+        {
+            DateTime t = {};
+            if (!f || strlen(f) < 10) return t;
+            t.year = digits(f, 4);
+            t.month = digits(f+5, 2);
+            t.day = digits(f+8, 2);
+            if (f[10] && strlen(f+11) >= 8) {
+                t.hour = digits(f+11, 2);
+                t.minute = digits(f+14, 2);
+                t.second = digits(f+17, 2);
+            }
+            return t;
+        }
+        static DateTime fromSql(SqlResultReader& r){ return fromField(r.nextField()); }
+    };
+
+    // a blob may hold zeros, its fromField() needs the length too.
+    template<>
+    struct SqlType<Blob>
+    {
+        static Blob fromField(const char* f, size_t len){ return f ? Blob(f, len) : Blob(); }
+        static Blob fromSql(SqlResultReader& r)
+        {
+            const char* f = r.nextField();
+            return fromField(f, r.fieldLength());
+        }
+    };
+
+    // the value of f, the field just read from r.
+    template<typename T>
+    T fieldValue(SqlResultReader&, const char* f){ return SqlType<T>::fromField(f); }
+
+    template<>
+    inline Blob fieldValue<Blob>(SqlResultReader& r, const char* f){ return SqlType<Blob>::fromField(f, r.fieldLength()); }
+
+    // a column that can be NULL, like std::optional<T> of c++17.
+    template<typename T>
+    struct Nullable
+    {
+        T       value;  // zero when null.
+        bool    null;
+
+        Nullable():value(),null(true){}
+        Nullable(const T& v):value(v),null(false){}
+        explicit operator bool()const{ return !null; }
+        const T& operator*()const{ return value; }
+        const T* operator->()const{ return &value; }
+    };
+
+    template<typename T>
+    struct SqlType< Nullable<T> >
+    {
+        static Nullable<T> fromSql(SqlResultReader& r)
+        {
+            const char* f = r.nextField();
+            if (!f) return Nullable<T>();
+            return fieldValue<T>(r, f);
+        }
+    };
+
+#ifdef SQLGEN_OPTIONAL
+    template<typename T>
+    struct SqlType< std::optional<T> >
+    {
+        static std::optional<T> fromSql(SqlResultReader& r)
+        {
+            const char* f = r.nextField();
+            if (!f) return std::nullopt;
+            return fieldValue<T>(r, f);
+        }
+    };
+#endif
+
+    // a single column result with its NULLs in a bitmap, values of NULL rows are zero.
+    template<typename T>
+    struct NullableColumn
+    {
+        std::vector<T>          values;
+        std::vector<unsigned>   nulls;  // bit i set when row i is NULL.
+
+        size_t  size()const{ return values.size(); }
+        bool    isNull(size_t i)const{ return (nulls[i/32] >> (i%32)) & 1; }
+        bool    hasNulls()const
+        {
+            for(size_t i=0; i<nulls.size(); i++) if (nulls[i]) return true;
+            return false;
+        }
+    };
+
+    template<typename T>
+    struct SqlType< NullableColumn<T> >
+    {
+        static NullableColumn<T> fromSql(SqlResultReader& r)
+        {
+            NullableColumn<T> ret;
+            ret.values.reserve(r.nrows);
+            ret.nulls.assign((r.nrows+31)/32, 0);
+            for(int i=0; i<r.nrows; i++){
+                const char* f = r.nextField();
+                ret.nulls[i/32] |= unsigned(!f) << (i%32);
+                ret.values.emplace_back(fieldValue<T>(r, f));
+            }
+            return ret;
+        }
+    };
+
+    // one row decoded column by column, e.g. several aggregates of one select.
+    template<typename... Ts>
+    struct SqlType< std::tuple<Ts...> >
+    {
+        static std::tuple<Ts...> fromSql(SqlResultReader& r)
+        {
+            // braced init evaluates in order, the columns are read left to right.
+            return std::tuple<Ts...>{ SqlType<Ts>::fromSql(r)... };
+        }
     };
 
     template<typename T>
@@ -70,45 +352,66 @@ namespace sqlgen
 
     //////////////////////////////////////////////////////////////////////////
 
-    template<typename A0>
-    void unpackResultValues(SqlResultReader& r, const std::function<void(A0)>& f)
+    namespace type_traits
     {
-        f( SqlType<A0>::fromSql(r) );
-    }
+        template<size_t... Is> 
+        struct indices {};
 
-    template<typename A0, typename A1>
-    void unpackResultValues(SqlResultReader& r, const std::function<void(A0,A1)>& f)
-    {
-        A0 a0 = SqlType<A0>::fromSql(r);
-        A1 a1 = SqlType<A1>::fromSql(r);
-        f(a0, a1);
-    }
+        template<size_t N, size_t... Is> 
+        struct make_indices : make_indices<N-1, N-1, Is...> {};
 
-    //////////////////////////////////////////////////////////////////////////
+        template<size_t... Is> 
+        struct make_indices<0, Is...> { typedef indices<Is...> type; };
 
-    namespace type_traits
-    {
         template <typename T>
         struct function_traits : function_traits<decltype(&T::operator())>
         {};
         // For generic types, directly use the result of the signature of its 'operator()'
 
-        template <typename C, typename R, typename A0>
-        struct function_traits<R(C::*)(A0) const>    
-        { 
-            typedef A0 Arg0;
-            typedef R (functionSig)(A0);
-        };
-        
-        template <typename C, typename R, typename A0, typename A1>
-        struct function_traits<R(C::*)(A0, A1) const>    
-        { 
-            typedef A0 Arg0;
-            typedef A1 Arg1;
-            typedef R (functionSig)(A0, A1);
+        template <typename R, typename... As>
+        struct function_traits<R(*)(As...)>
+        {
+            typedef std::tuple<As...>                                   Args;
+            typedef std::tuple<typename std::decay<As>::type...>        Values;
+            typedef typename make_indices<sizeof...(As)>::type          Indices;
+            typedef R (functionSig)(As...);
         };
+
+        template <typename C, typename R, typename... As>
+        struct function_traits<R(C::*)(As...) const> : function_traits<R(*)(As...)>
+        {};
+
+        template <typename C, typename R, typename... As>
+        struct function_traits<R(C::*)(As...)> : function_traits<R(*)(As...)>
+        {};
+    }
+
+    // by value arguments are moved from the decoded values, references bind to them.
+    template<typename Args, typename Func, typename Values, size_t... Is>
+    void applyResultValues(Func& f, Values& v, type_traits::indices<Is...>)
+    {
+        f( static_cast<typename std::tuple_element<Is, Args>::type&&>(std::get<Is>(v))... );
+    }
+
+    // decode the callback's arguments from the reader, left to right, and call it:
+    // [](const vector<Users::Row>& all){}, [](int count, float avg){}...
+    template<typename Func>
+    void unpackResultValues(SqlResultReader& r, Func& f)
+    {
+        typedef type_traits::function_traits<Func> Traits;
+        typename Traits::Values v = SqlType<typename Traits::Values>::fromSql(r);
+        applyResultValues<typename Traits::Args>(f, v, typename Traits::Indices());
+    }
+
+    // call the callback once per row, its arguments must take whole rows.
+    template<typename Func>
+    void unpackResultRows(SqlResultReader& r, Func& f)
+    {
+        for(int i=0; i<r.nrows; i++) unpackResultValues(r, f);
     }
 
+    //////////////////////////////////////////////////////////////////////////
+
 
 #ifdef SQLGEN_MYSQL
 
@@ -117,27 +420,105 @@ namespace sqlgen
         MYSQL_RES* result;
         int curField;
         char** current;
+        size_t lastLength;
 
-        MysqlResultReader():current(0),curField(0), result(0){}        
+        MysqlResultReader():current(0),curField(0), result(0), lastLength(0){}        
         ~MysqlResultReader();
         const char* nextField();
         void nextRow();
+        size_t fieldLength(){ return lastLength; }
         bool init(MYSQL* con);
     };
 
+    struct MysqlConnection : SqlConnection
+    {
+        MYSQL* con;
+        MYSQL* killCon;     // side connection sending KILL QUERY for cancel(), none if null.
+
+        explicit MysqlConnection(MYSQL* c, MYSQL* killCon_=0):con(c),killCon(killCon_){}
+        SqlDialect          dialect()const{return DialectMysql;}
+        SqlResultReader*    execute(const char* sql);
+        const char*         error();
+        void                cancel();
+    };
+
+#endif
+
+#ifdef SQLGEN_SQLITE
+
+    struct SqliteConnection : SqlConnection
+    {
+        sqlite3*    db;
+        std::string err;
+
+        explicit SqliteConnection(sqlite3* d):db(d){}
+        SqlDialect          dialect()const{return DialectSqlite;}
+        SqlResultReader*    execute(const char* sql);
+        const char*         error(){return err.c_str();}
+        void                cancel(){sqlite3_interrupt(db);}
+    };
+
+#endif
+
+    //////////////////////////////////////////////////////////////////////////
+
+    // run a statement without caring about its result.
+    bool execute(SqlConnection& c, const std::string& ss);
+    inline bool execute(const std::string& ss){ return execute(*getConnection(), ss); }
+
+    // writes going through these invalidate the cached results of their table.
+    bool execute(SqlConnection& c, const Insert& s);
+    bool execute(SqlConnection& c, const Update& s);
+    bool execute(SqlConnection& c, const Delete& s);
+    inline bool execute(const Insert& s){ return execute(*getConnection(), s); }
+    inline bool execute(const Update& s){ return execute(*getConnection(), s); }
+    inline bool execute(const Delete& s){ return execute(*getConnection(), s); }
+
+    // run a select through the result cache if any.
+    SqlResultReader* executeSelect(SqlConnection& c, const std::string& sql, const Select& s);
+    // run a select, merging the chunks of an oversized `IN` list.
+    SqlResultReader* executeSelect(SqlConnection& c, const Select& s);
 
+    // whole result callbacks.
     template<typename Func>
-    void query(const std::string& ss, Func f) 
+    void query(SqlConnection& c, const std::string& ss, Func f) 
     {
-        mysql_query(con, ss.c_str());
-        MysqlResultReader r;
-        if (r.init(con)) {
-            std::function<typename type_traits::function_traits<Func>::functionSig > ff(f);
-            unpackResultValues(r, ff);            
-        }
+        std::unique_ptr<SqlResultReader> r(c.execute(ss.c_str()));
+        if (r) unpackResultValues(*r, f);
     }
 
-#endif
+    template<typename Func>
+    void query(SqlConnection& c, const Select& s, Func f)
+    {
+        std::unique_ptr<SqlResultReader> r(executeSelect(c, s));
+        if (r) unpackResultValues(*r, f);
+    }
+
+    template<typename Func>
+    void query(const std::string& ss, Func f){ query(*getConnection(), ss, f); }
+
+    template<typename Func>
+    void query(const Select& s, Func f){ query(*getConnection(), s, f); }
 
+    // per row callbacks: queryEach(sel, [](const std::string& name, int age){}).
+    template<typename Func>
+    void queryEach(SqlConnection& c, const std::string& ss, Func f) 
+    {
+        std::unique_ptr<SqlResultReader> r(c.execute(ss.c_str()));
+        if (r) unpackResultRows(*r, f);
+    }
+
+    template<typename Func>
+    void queryEach(SqlConnection& c, const Select& s, Func f)
+    {
+        std::unique_ptr<SqlResultReader> r(executeSelect(c, s));
+        if (r) unpackResultRows(*r, f);
+    }
+
+    template<typename Func>
+    void queryEach(const std::string& ss, Func f){ queryEach(*getConnection(), ss, f); }
+
+    template<typename Func>
+    void queryEach(const Select& s, Func f){ queryEach(*getConnection(), s, f); }
 
 }
@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "tableDef.h"
+#include <algorithm>
 
 
 using namespace sqlgen;
@@ -12,16 +13,19 @@ using std::string;
 
 
 //#define PROFILE
+#if defined(SQLGEN_SQLITE)
+#define DB_SQLITE
+#else
 #define DB_MYSQL
-//#define DB_SQLITE
+#endif
 
 //////////////////////////////////////////////////////////////////////////
 int cnt=0;
 size_t maxSz=0;
 
-void* operator new(size_t sz) throw(std::bad_alloc){
+void* operator new(size_t sz){
     cnt++;
-    maxSz=__max(maxSz, sz);
+    maxSz=std::max(maxSz, sz);
     return malloc(sz); 
 }
 void operator delete(void* p){
@@ -45,7 +49,7 @@ void close_db(){}
 
 #ifdef DB_SQLITE
 
-#include "sqlite/sqlite3.h"
+#include <sqlite3.h>
 sqlite3* db;
 
 static int callback(void *NotUsed, int argc, char **argv, char **azColName){
@@ -65,8 +69,11 @@ void exe(const char* s){
 }
 void open_db(){
     sqlite3_open(":memory:", &db);
+    setConnection(new SqliteConnection(db));
+    setDefaultDialect(DialectSqlite);
 }
 void close_db(){
+    delete getConnection();
     sqlite3_close(db);    
 }
 #endif
@@ -86,9 +93,13 @@ void open_db(){
         exit(1);
     }
     mysql_select_db(con, "test");
+    setConnection(new MysqlConnection(con));
 }
 
-void close_db(){ mysql_close(con); }
+void close_db(){ 
+    delete getConnection();
+    mysql_close(con); 
+}
 
 void exe(const char* s){
     puts(s);    
@@ -157,6 +168,15 @@ void test()
         .groupBy(userTable.name).having(count(userTable.age) >= 1);
     exe(sql);
 
+    FuncCall total=sum(userTable.score);
+    Alias totalScore=total.as("totalScore");
+    sql=Select().select(userTable.tag, userTable.age, totalScore)
+        .from(userTable)
+        .groupBy(userTable.tag, userTable.age)
+        .orderBy(totalScore, OrderDesc)
+        .orderBy(userTable.tag);
+    exe(sql);
+
 
     sql=Update().update(userTable)
         .set(userTable.age=33, userTable.name="lis", userTable.addr="bbb", userTable.score=999,userTable.tag="OK")
@@ -195,6 +215,16 @@ void testDataQuery()
     data.tag="k";
     exe(Insert().insertInto(userTable).values(UnpackRowValues_Users(data,userTable)));
 
+    vector<Users::Row> rows(3, data);
+    Insert batch;
+    batch.insertInto(userTable);
+    for(unsigned i=0; i<rows.size(); i++){
+        rows[i].score=i;
+        batch.values(UnpackRowValues_Users(rows[i], userTable));
+    }
+    batch.onConflict(userTable.name).onDuplicateKeyUpdate(userTable.score=values(userTable.score));
+    exe(batch);
+
 
     exe(Select().from(userTable));
     query(Select().from(userTable),
@@ -202,6 +232,11 @@ void testDataQuery()
 
     query(Select().select(count(Star()), Literal(1)).from(userTable), 
         [](int a, int b){ });
+
+    vector<int> ages;
+    for(int i=0; i<5000; i++) ages.push_back(i);
+    query(Select().from(userTable).where(userTable.age.in(ages)),
+        [](const vector<Users::Row>& u){});
 }
 
 int main()
@@ -218,7 +253,7 @@ int main()
     test();
 #endif
         
-    printf("num memory alloc: %d, maxSize:%d\n", cnt, maxSz);
+    printf("num memory alloc: %d, maxSize:%d\n", cnt, static_cast<int>(maxSz));
 
 #ifndef PROFILE
     getchar();
@@ -0,0 +1,8 @@
+// precompiled header of the msvc projects, a plain header elsewhere.
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
@@ -1,6 +1,6 @@
 // Generate at Fri Jan 16 17:26:39 2015
 #pragma once
-#include "sqlgen.h"
+#include "SqlGen.h"
 #include "SqlUtils.h"
 
 
@@ -8,8 +8,10 @@ namespace dao
 {
     using namespace sqlgen;
     
+#ifdef _MSC_VER
     #pragma warning(push)
     #pragma warning(disable:4355) //'this' : used in base member initializer list
+#endif
     
     struct Class : Table
     {
@@ -69,5 +71,7 @@ namespace dao
     };
        
 
+#ifdef _MSC_VER
     #pragma warning(pop)
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,638 @@
+// differential fuzzing of the rendering paths. random statements over the tableDef.h tables
+// are rendered by the reference path(a fresh builder and buffer) and by the optimized ones:
+// - pooled render buffers and reused builders re-rendering their changed clauses only, which
+//   must give the same sql byte for byte in every dialect.
+// - simplified expressions and chunked `IN` lists, which must give the same results on an in
+//   memory sqlite database. writes are run on two databases, one per path, then compared.
+// the render and execution throughput of each path is measured on the last statements.
+//   fuzz_sql [iterations] [seed]
+
+#include "tableDef.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <random>
+
+using namespace sqlgen;
+using namespace dao;
+
+static Users users;
+static Class classes;
+
+// the nodes of the statements generated since the last clear(), they hold each other by reference.
+struct Arena
+{
+    std::deque<Literal>         literals;
+    std::deque<BinExp>          bins;
+    std::deque<InList>          inLists;
+    std::deque<Case>            cases;
+    std::deque<FuncCall>        funcs;
+    std::deque<Alias>           aliases;
+    std::deque<Join>            joins;
+    std::deque<string>          strings;
+    std::deque<vector<int>>     intKeys;
+    std::deque<vector<string>>  strKeys;
+
+    void clear()
+    {
+        literals.clear(); bins.clear(); inLists.clear(); cases.clear(); funcs.clear();
+        aliases.clear(); joins.clear(); strings.clear(); intKeys.clear(); strKeys.clear();
+    }
+};
+
+struct SelectSpec
+{
+    const Join*         join;
+    vector<const Exp*>  fields;
+    const Exp*          where;
+    vector<const Exp*>  groupBy;
+    const BinExp*       having;
+    vector<OrderKey>    orderBy;
+    int                 limit, offset;
+
+    SelectSpec():join(0),where(0),having(0),limit(0),offset(0){}
+};
+
+struct UpdateSpec
+{
+    vector<const BinExp*>   sets;
+    const Exp*              where;
+
+    UpdateSpec():where(0){}
+};
+
+namespace sqlgen{
+    static bool operator==( const OrderKey& a, const OrderKey& b ){ return a.exp==b.exp && a.type==b.type; }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+static const char* sampleStrings[] = { "", "a", "user1", "user12", "o'k", "back\\slash", "%", "x_y", "Abc" };
+static const char* patterns[] = { "a%", "%1", "user_%", "%'%", "%\\%", "_" };
+static const char* aliasNames[] = { "c0", "c1", "c2", "c3", "c4" };
+
+struct Generator
+{
+    std::mt19937    rng;
+    Arena&          a;
+    bool            join;
+
+    Generator(unsigned seed, Arena& a_):rng(seed),a(a_),join(false){}
+
+    int rnd(int n){ return std::uniform_int_distribution<int>(0, n-1)(rng); }
+
+    const Exp& lit(const Literal& l){ a.literals.push_back(l); return a.literals.back(); }
+    const BinExp& bin(BinExp::OpType t, const Exp& l, const Exp& r){ a.bins.emplace_back(t, l, r); return a.bins.back(); }
+    const Exp& str(const char* s){ a.strings.push_back(s); return lit(a.strings.back()); }
+
+    const Exp& numField()
+    {
+        switch(rnd(join ? 3 : 2)){
+        case 0: return users.age;
+        case 1: return users.score;
+        default: return classes.age;
+        }
+    }
+
+    const Exp& strField()
+    {
+        switch(rnd(join ? 4 : 3)){
+        case 0: return users.name;
+        case 1: return users.addr;
+        case 2: return users.tag;
+        default: return classes.name;
+        }
+    }
+
+    const Exp& num(int depth)
+    {
+        static const BinExp::OpType ops[] = { BinExp::Add, BinExp::Sub, BinExp::Mul, BinExp::Div, BinExp::Mod };
+        switch(depth > 0 ? rnd(8) : rnd(3)){
+        case 0: return numField();
+        case 1: return lit(rnd(41)-10);
+        // integral reals too: folding them must not turn `/` into an integer division.
+        case 2: return rnd(3) ? lit((rnd(21)-5)/2.0) : lit(static_cast<float>(rnd(9)-2));
+        case 3: case 4: return bin(ops[rnd(5)], num(depth-1), num(depth-1));
+        case 5: return bin(ops[rnd(3)], lit(rnd(11)-3), lit(rnd(7)));
+        case 6: a.cases.emplace_back(cond(depth-1), num(depth-1), rnd(2) ? &num(depth-1) : 0); return a.cases.back();
+        default: return bin(BinExp::Add, numField(), lit(rnd(5)));
+        }
+    }
+
+    const Exp& text(int depth)
+    {
+        switch(depth > 0 ? rnd(4) : rnd(2)){
+        case 0: return strField();
+        case 1: return str(sampleStrings[rnd(sizeof(sampleStrings)/sizeof(*sampleStrings))]);
+        case 2: return strField();
+        default: a.cases.emplace_back(cond(depth-1), text(depth-1), &text(depth-1)); return a.cases.back();
+        }
+    }
+
+    // keys are unique: a key repeated across chunks would give its rows twice.
+    const Exp& inList()
+    {
+        bool negate = rnd(3)==0;
+        if (rnd(2)) {
+            a.intKeys.push_back(vector<int>());
+            for(int k=rnd(8)-2; k<30; k+=1+rnd(6)) a.intKeys.back().push_back(k);
+            a.inLists.emplace_back(numField(), negate, a.intKeys.back().data(), a.intKeys.back().size());
+        }
+        else {
+            a.strKeys.push_back(vector<string>());
+            for(int k=rnd(3); k<20; k+=1+rnd(4)) a.strKeys.back().push_back("user"+std::to_string(k));
+            a.strKeys.back().push_back("o'k");
+            a.inLists.emplace_back(strField(), negate, a.strKeys.back().data(), a.strKeys.back().size());
+        }
+        return a.inLists.back();
+    }
+
+    const Exp& cond(int depth)
+    {
+        static const BinExp::OpType cmps[] = { BinExp::LargerThan, BinExp::LessThan, BinExp::Equ, BinExp::LargerEqu, BinExp::LessEqu, BinExp::NotEqu };
+        switch(depth > 0 ? rnd(9) : rnd(4)){
+        case 0: case 4: return bin(cmps[rnd(6)], num(depth-1), num(depth-1));
+        case 1: return bin(cmps[rnd(6)], text(depth-1), text(depth-1));
+        case 2: return bin(BinExp::Like, text(depth-1), str(patterns[rnd(sizeof(patterns)/sizeof(*patterns))]));
+        case 3: return inList();
+        case 5: case 6: return bin(BinExp::And, cond(depth-1), cond(depth-1));
+        case 7: return bin(BinExp::Or, cond(depth-1), cond(depth-1));
+        default: return bin(rnd(2) ? BinExp::And : BinExp::Or, cond(depth-1), lit(rnd(2)==0));
+        }
+    }
+
+    const Exp& aggregate()
+    {
+        static const FuncCall::FuncType types[] = { FuncCall::Count, FuncCall::Sum, FuncCall::Min, FuncCall::Max, FuncCall::Avg };
+        FuncCall::FuncType t = types[rnd(5)];
+        switch(rnd(4)){
+        case 0: a.funcs.emplace_back(t, num(1), false, &cond(1)); break;
+        case 1: a.funcs.emplace_back(FuncCall::Count, rnd(2) ? numField() : strField(), rnd(2)==0); break;
+        default: a.funcs.emplace_back(t, num(2)); break;
+        }
+        return a.funcs.back();
+    }
+
+    const Exp& maybeAlias(const Exp& e, int i)
+    {
+        if (rnd(4)) return e;
+        a.aliases.emplace_back(e, aliasNames[i]);
+        return a.aliases.back();
+    }
+
+    SelectSpec select()
+    {
+        SelectSpec s;
+        join = rnd(5)==0;
+        if (join) {
+            a.joins.emplace_back(users, classes, bin(BinExp::Equ, classes.age, users.age), rnd(3) ? JoinInner : JoinLeft);
+            s.join = &a.joins.back();
+        }
+
+        if (rnd(4)==0) {
+            for(int i=rnd(2); i<2; i++) s.groupBy.push_back(rnd(2) ? &numField() : &strField());
+            s.fields = s.groupBy;
+            for(int i=rnd(3); i<3; i++) s.fields.push_back(&maybeAlias(aggregate(), static_cast<int>(s.fields.size())));
+            if (rnd(3)==0) s.having = &bin(BinExp::LargerThan, aggregate(), lit(rnd(20)));
+        }
+        else if (rnd(8)) {
+            for(int i=rnd(3); i<4; i++) s.fields.push_back(&maybeAlias(rnd(2) ? num(2) : text(2), i));
+        }
+        if (rnd(10) < 7) s.where = &cond(3);
+        for(int i=rnd(4); i<2; i++){
+            OrderKey k = { s.fields.size() && rnd(2) ? s.fields[rnd(static_cast<int>(s.fields.size()))] : &num(1), rnd(2) ? OrderAsc : OrderDesc };
+            s.orderBy.push_back(k);
+        }
+
+        // a limit needs a total order to pick the same rows whatever the plan.
+        if (s.fields.size() && rnd(3)==0) {
+            s.limit = 1+rnd(10);
+            s.offset = rnd(3) ? 0 : rnd(5);
+            for(unsigned i=0; i<s.fields.size(); i++){
+                OrderKey k = { s.fields[i], OrderAsc };
+                s.orderBy.push_back(k);
+            }
+        }
+        return s;
+    }
+
+    // the next statement of a reused builder: some clauses of the previous one are kept.
+    SelectSpec mutate(const SelectSpec& prev)
+    {
+        SelectSpec s = select();
+        if (!prev.join && !s.join && prev.groupBy.empty() && s.groupBy.empty()) {
+            join = false;
+            if (rnd(2)) s.fields = prev.fields;
+            if (rnd(2)) s.where = prev.where;
+            if (rnd(2)) s.orderBy = prev.orderBy;
+            if (rnd(2)) {
+                s.limit = prev.limit;
+                s.offset = prev.offset;
+            }
+            if (s.limit && s.fields.empty()) s.limit = s.offset = 0;
+        }
+        return s;
+    }
+
+    UpdateSpec update()
+    {
+        UpdateSpec s;
+        join = false;
+        s.sets.push_back(&bin(BinExp::Assign, users.score, num(2)));
+        if (rnd(2)) s.sets.push_back(&bin(BinExp::Assign, users.tag, text(1)));
+        if (rnd(5)) s.where = &cond(2);
+        return s;
+    }
+
+    const Exp& deleteWhere()
+    {
+        join = false;
+        return bin(BinExp::And, cond(2), bin(BinExp::LargerThan, users.age, lit(20+rnd(15))));
+    }
+
+    // rows of random values, columns left out are NULL.
+    void insert(Insert& ins)
+    {
+        ins.insertInto(users);
+        bool withAddr = rnd(3)!=0, withScore = rnd(4)!=0;
+        for(int r=1+rnd(4); r>0; r--){
+            const BinExp& name = bin(BinExp::Assign, users.name, str(("user"+std::to_string(rnd(25))).c_str()));
+            const BinExp& age = bin(BinExp::Assign, users.age, lit(rnd(40)));
+            const BinExp& addr = bin(BinExp::Assign, users.addr, str(sampleStrings[rnd(sizeof(sampleStrings)/sizeof(*sampleStrings))]));
+            const BinExp& score = bin(BinExp::Assign, users.score, lit(rnd(100)-20));
+            const BinExp& tag = bin(BinExp::Assign, users.tag, str(rnd(2) ? "t" : "o'k"));
+            if (withAddr && withScore) ins.values(name, age, addr, score, tag);
+            else if (withAddr) ins.values(name, age, addr, tag);
+            else if (withScore) ins.values(name, age, score, tag);
+            else ins.values(name, age, tag);
+        }
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////
+
+static void build( const SelectSpec& s, Select& q )
+{
+    if (s.join) q.from(*s.join);
+    else q.from(users);
+    for(unsigned i=0; i<s.fields.size(); i++) q.select(*s.fields[i]);
+    if (s.where) q.where(*s.where);
+    for(unsigned i=0; i<s.groupBy.size(); i++) q.groupBy(*s.groupBy[i]);
+    if (s.having) q.having(*s.having);
+    for(unsigned i=0; i<s.orderBy.size(); i++) q.orderBy(*s.orderBy[i].exp, s.orderBy[i].type);
+    q.limit(s.limit).offset(s.offset);
+}
+
+// takes a reused builder from `prev` to `s`, only replacing the clauses that differ.
+static void rebuild( const SelectSpec& prev, const SelectSpec& s, Select& q )
+{
+    if (prev.join!=s.join) {
+        q.clear(Select::ClauseFrom);
+        if (s.join) q.from(*s.join);
+        else q.from(users);
+    }
+    if (prev.fields!=s.fields) {
+        q.clear(Select::ClauseFields);
+        for(unsigned i=0; i<s.fields.size(); i++) q.select(*s.fields[i]);
+    }
+    if (prev.where!=s.where) {
+        if (s.where) q.where(*s.where);
+        else q.clear(Select::ClauseWhere);
+    }
+    if (prev.groupBy!=s.groupBy) {
+        q.clear(Select::ClauseGroupBy);
+        for(unsigned i=0; i<s.groupBy.size(); i++) q.groupBy(*s.groupBy[i]);
+    }
+    if (prev.having!=s.having) {
+        if (s.having) q.having(*s.having);
+        else q.clear(Select::ClauseHaving);
+    }
+    if (prev.orderBy!=s.orderBy) {
+        q.clear(Select::ClauseOrderBy);
+        for(unsigned i=0; i<s.orderBy.size(); i++) q.orderBy(*s.orderBy[i].exp, s.orderBy[i].type);
+    }
+    if (prev.limit!=s.limit || prev.offset!=s.offset) q.limit(s.limit).offset(s.offset);
+}
+
+static void build( const UpdateSpec& s, Update& q )
+{
+    q.update(users);
+    for(unsigned i=0; i<s.sets.size(); i++) q.set(*s.sets[i]);
+    if (s.where) q.where(*s.where);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+static int failures;
+static long long renderChecks, resultChecks, bothFailed;
+
+static void fail( const char* what, const string& a, const string& b )
+{
+    failures++;
+    if (failures > 10) return;
+    printf("%s\n  %s\n  %s\n", what, a.c_str(), b.c_str());
+}
+
+static void checkSame( const char* what, const string& ref, const string& other )
+{
+    renderChecks++;
+    if (ref!=other) fail(what, ref, other);
+}
+
+// a result as sorted rows, or "error" when the statement failed.
+static vector<string> rowsOf( SqlConnection& c, SqlResultReader* r )
+{
+    vector<string> rows;
+    if (!r) {
+        if (*c.error()) rows.push_back(string("error: ")+c.error());
+        return rows;
+    }
+    for(int i=0; i<r->nrows; i++){
+        string row;
+        for(int k=0; k<r->nfields; k++){
+            const char* f = r->nextField();
+            row += f ? string(f, r->fieldLength()) : string("\x01NULL");
+            row += '\x1f';
+        }
+        rows.push_back(row);
+    }
+    delete r;
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+static vector<string> run( SqlConnection& c, const string& sql ){ return rowsOf(c, c.execute(sql.c_str())); }
+
+static string describe( const string& sql, const vector<string>& rows )
+{
+    string s = sql + "  -> " + std::to_string(rows.size()) + " rows";
+    if (rows.size()) s += ", first: " + rows[0];
+    return s;
+}
+
+static void checkResults( const char* what, const string& refSql, const vector<string>& ref, const string& sql, const vector<string>& got )
+{
+    resultChecks++;
+    if (ref.size()==1 && got.size()==1 && !ref[0].compare(0, 6, "error:") && !got[0].compare(0, 6, "error:")) bothFailed++;
+    else if (ref!=got) fail(what, describe(refSql, ref), describe(sql, got));
+}
+
+static const char* contentSql = "SELECT name,age,addr,score,tag FROM Users";
+
+//////////////////////////////////////////////////////////////////////////
+
+// the sql of a fresh builder, with fresh buffers(the reference) or the pooled ones.
+template<typename Spec, typename Stmt>
+static string render( const Spec& s, SqlDialect d, bool pooled )
+{
+    setRenderBufferLimit(pooled ? 64*1024 : 0);
+    Stmt q;
+    build(s, q);
+    string sql = q.toSql(d);
+    setRenderBufferLimit(64*1024);
+    return sql;
+}
+
+template<typename Stmt>
+static string renderSimplified( const Stmt& q, SqlDialect d )
+{
+    setSimplifyExpressions(true);
+    string sql = q.toSql(d);
+    setSimplifyExpressions(false);
+    return sql;
+}
+
+struct Fuzzer
+{
+    SqliteConnection&   ref;    // runs the reference sql of writes.
+    SqliteConnection&   opt;    // runs the simplified sql of writes.
+    Select              reused;
+    SelectSpec          prev;
+    Update              reusedUpdate;
+    Insert              reusedInsert;
+
+    Fuzzer(SqliteConnection& ref_, SqliteConnection& opt_):ref(ref_),opt(opt_)
+    {
+        reused.cacheSql();
+        reusedUpdate.cacheSql();
+        reusedInsert.cacheSql();
+    }
+
+    void restart()
+    {
+        reused.reset().from(users);
+        prev = SelectSpec();
+        reusedUpdate.reset();
+        reusedInsert.reset();
+    }
+
+    void select( const SelectSpec& s )
+    {
+        string sql = render<SelectSpec, Select>(s, DialectSqlite, false);
+        for(int d=DialectMysql; d<=DialectPostgres; d++){
+            string r = d==DialectSqlite ? sql : render<SelectSpec, Select>(s, SqlDialect(d), false);
+            checkSame("pooled buffers", r, render<SelectSpec, Select>(s, SqlDialect(d), true));
+        }
+
+        rebuild(prev, s, reused);
+        prev = s;
+        checkSame("reused builder", sql, reused.toSql(DialectSqlite));
+        reused.offset(s.offset+1);
+        Select moved;
+        build(s, moved);
+        checkSame("reused builder, offset changed", moved.offset(s.offset+1).toSql(DialectSqlite), reused.toSql(DialectSqlite));
+        reused.offset(s.offset);
+
+        vector<string> rows = run(ref, sql);
+        Select q;
+        build(s, q);
+        string simple = renderSimplified(q, DialectSqlite);
+        checkResults("simplified", sql, rows, simple, run(ref, simple));
+
+        // the chunks are merged as is, they can't be grouped, ordered or limited.
+        if (s.groupBy.empty() && s.orderBy.empty() && !s.limit) {
+            setInListChunkSize(3);
+            checkResults("chunked in list", sql, rows, "(chunks)", rowsOf(ref, executeSelect(ref, q)));
+            setInListChunkSize(1000);
+        }
+    }
+
+    void write( const string& refSql, const string& optSql )
+    {
+        vector<string> a = rowsOf(ref, ref.execute(refSql.c_str()));
+        vector<string> b = rowsOf(opt, opt.execute(optSql.c_str()));
+        checkResults("simplified write", refSql, a, optSql, b);
+        checkResults("table content after write", refSql, run(ref, contentSql), optSql, run(opt, contentSql));
+    }
+
+    void update( const UpdateSpec& s )
+    {
+        string sql = render<UpdateSpec, Update>(s, DialectSqlite, false);
+        for(int d=DialectMysql; d<=DialectPostgres; d++){
+            string r = d==DialectSqlite ? sql : render<UpdateSpec, Update>(s, SqlDialect(d), false);
+            checkSame("pooled buffers", r, render<UpdateSpec, Update>(s, SqlDialect(d), true));
+        }
+        reusedUpdate.clear(Update::ClauseSet);
+        if (!s.where) reusedUpdate.clear(Update::ClauseWhere);
+        build(s, reusedUpdate);
+        checkSame("reused update", sql, reusedUpdate.toSql(DialectSqlite));
+
+        Update q;
+        build(s, q);
+        write(sql, renderSimplified(q, DialectSqlite));
+    }
+
+    void remove( const Exp& where )
+    {
+        Delete q;
+        q.from(users).where(where);
+        write(q.toSql(DialectSqlite), renderSimplified(q, DialectSqlite));
+    }
+
+    void insert( Generator& g )
+    {
+        Insert q;
+        g.insert(q);
+        reusedInsert.clear(Insert::ClauseValues);
+        reusedInsert.insertInto(users).m_values = q.m_values;
+        reusedInsert.m_numcols = q.m_numcols;
+        reusedInsert.m_cache.touch(Insert::ClauseValues);
+        string sql = q.toSql(DialectSqlite);
+        checkSame("reused insert", sql, reusedInsert.toSql(DialectSqlite));
+        write(sql, sql);
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////
+
+typedef std::chrono::steady_clock Clock;
+
+static double perSecond( long long n, Clock::time_point begin )
+{
+    return n / std::chrono::duration<double>(Clock::now()-begin).count();
+}
+
+// throughput of each path on the same statements.
+static void measure( const vector<SelectSpec>& specs, SqliteConnection& c )
+{
+    const int rounds = std::max(1, 200000/static_cast<int>(specs.size()));
+    long long n = static_cast<long long>(rounds)*specs.size();
+    size_t sink = 0;
+
+    Clock::time_point t = Clock::now();
+    setRenderBufferLimit(0);
+    for(int r=0; r<rounds; r++) for(unsigned i=0; i<specs.size(); i++){
+        Select q;
+        build(specs[i], q);
+        sink += q.toSql(DialectSqlite).size();
+    }
+    setRenderBufferLimit(64*1024);
+    double fresh = perSecond(n, t);
+
+    t = Clock::now();
+    for(int r=0; r<rounds; r++) for(unsigned i=0; i<specs.size(); i++){
+        Select q;
+        build(specs[i], q);
+        sink += q.toSql(DialectSqlite).size();
+    }
+    double pooled = perSecond(n, t);
+
+    // paging through a result: only the offset changes between renderings.
+    vector<Select> reused(specs.size());
+    for(unsigned i=0; i<specs.size(); i++) build(specs[i], reused[i]);
+    t = Clock::now();
+    for(int r=0; r<rounds; r++) for(unsigned i=0; i<specs.size(); i++){
+        sink += reused[i].offset(r%8).toSql(DialectSqlite).size();
+    }
+    double paged = perSecond(n, t);
+
+    setSimplifyExpressions(true);
+    t = Clock::now();
+    for(int r=0; r<rounds; r++) for(unsigned i=0; i<specs.size(); i++){
+        Select q;
+        build(specs[i], q);
+        sink += q.toSql(DialectSqlite).size();
+    }
+    setSimplifyExpressions(false);
+    double simple = perSecond(n, t);
+
+    printf("render/s: reference %.0f, pooled buffers %.0f, reused builder(offset changed) %.0f, simplified %.0f\n",
+        fresh, pooled, paged, simple);
+
+    vector<string> plain, simpler;
+    for(unsigned i=0; i<specs.size(); i++){
+        Select q;
+        build(specs[i], q);
+        plain.push_back(q.toSql(DialectSqlite));
+        simpler.push_back(renderSimplified(q, DialectSqlite));
+    }
+    const int execRounds = std::max(1, 2000/static_cast<int>(specs.size()));
+    long long m = static_cast<long long>(execRounds)*specs.size();
+    t = Clock::now();
+    for(int r=0; r<execRounds; r++) for(unsigned i=0; i<plain.size(); i++) sink += run(c, plain[i]).size();
+    double execPlain = perSecond(m, t);
+    t = Clock::now();
+    for(int r=0; r<execRounds; r++) for(unsigned i=0; i<simpler.size(); i++) sink += run(c, simpler[i]).size();
+    double execSimple = perSecond(m, t);
+    printf("sqlite select/s: reference %.0f, simplified %.0f%s\n", execPlain, execSimple, sink ? "" : " ");
+}
+
+static sqlite3* openDb()
+{
+    sqlite3* db;
+    sqlite3_open(":memory:", &db);
+    sqlite3_exec(db, "create table Users(name varchar(255), age int, addr varchar(255), score int, tag varchar(255));"
+        "create table Class(name varchar(255), age int);", 0, 0, 0);
+    return db;
+}
+
+int main( int argc, char** argv )
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(atoi(argv[2])) : 1;
+    printf("fuzz_sql %d %u\n", iterations, seed);
+
+    sqlite3* refDb = openDb();
+    sqlite3* optDb = openDb();
+    SqliteConnection ref(refDb), opt(optDb);
+    for(int i=0; i<10; i++){
+        string sql = "insert into Class values('class" + std::to_string(i) + "'," + std::to_string(i*4) + ")";
+        delete ref.execute(sql.c_str());
+        delete opt.execute(sql.c_str());
+    }
+
+    Arena arena;
+    Generator g(seed, arena);
+    Fuzzer f(ref, opt);
+    for(int i=0; i<20; i++) f.insert(g);
+
+    // nodes of the last batch are kept for the measures.
+    const int batch = 200;
+    vector<SelectSpec> specs;
+    for(int i=0; i<iterations; i++){
+        if (i%batch==0) {
+            f.restart();
+            specs.clear();
+            arena.clear();
+        }
+        int kind = g.rnd(20);
+        if (kind < 14) {
+            SelectSpec s = g.mutate(f.prev);
+            specs.push_back(s);
+            f.select(s);
+        }
+        else if (kind < 17) f.update(g.update());
+        else if (kind < 19) f.insert(g);
+        else f.remove(g.deleteWhere());
+    }
+
+    printf("%lld render checks, %lld result checks(%lld failed on both paths), %d mismatches\n",
+        renderChecks, resultChecks, bothFailed, failures);
+    if (specs.size()) measure(specs, ref);
+
+    sqlite3_close(refDb);
+    sqlite3_close(optDb);
+    return failures ? 1 : 0;
+}
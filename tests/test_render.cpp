@@ -0,0 +1,340 @@
+// rendering of the statement builders, no database needed.
+
+#include "SqlGen.h"
+#include "SqlTyped.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <thread>
+
+using namespace sqlgen;
+
+struct Users : Table
+{
+    Field name;
+    Field age;
+    Field score;
+
+    Users()
+        : Table("Users")
+        , name  (this, SqlString, "name")
+        , age   (this, SqlInt   , "age")
+        , score (this, SqlDouble, "score")
+    {}
+};
+
+struct Orders : Table
+{
+    TField<int>     id;
+    TField<string>  owner;
+    TField<double>  total;
+
+    Orders()
+        : Table("Orders")
+        , id    (this, "id")
+        , owner (this, "owner")
+        , total (this, "total")
+    {}
+};
+
+struct Counters : Table
+{
+    TField<int64_t>     hits;
+    TField<unsigned>    port;
+    TField<uint64_t>    bytes;
+
+    Counters()
+        : Table("Counters")
+        , hits  (this, "hits")
+        , port  (this, "port")
+        , bytes (this, "bytes")
+    {}
+};
+
+static Users users;
+static Orders orders;
+static Counters counters;
+static int failed;
+
+static void check( const string& got, const char* expected, int line )
+{
+    if (got == expected) return;
+    failed++;
+    printf("line %d\n  got      %s\n  expected %s\n", line, got.c_str(), expected);
+}
+#define CHECK(got, expected) check(got, expected, __LINE__)
+
+static void testSelect()
+{
+    CHECK(Select().select(users.name, users.age).from(users).where(users.age > 18 && users.name.like("a%"))
+        .orderBy(users.score, OrderDesc).limit(10).offset(20).toSql(DialectMysql),
+        "SELECT name,age FROM Users WHERE (age > 18) AND (name LIKE 'a%') ORDER BY score DESC LIMIT 10 OFFSET 20");
+    CHECK(Select().select(users.name, orders.total).from(users.join(orders, orders.owner==users.name))
+        .where(orders.total >= 1.5).toSql(DialectSqlite),
+        "SELECT Users.name,Orders.total FROM Users JOIN Orders ON Orders.owner=Users.name WHERE Orders.total >= 1.5");
+    CHECK(Select().select(users.age, count(users.name).as("n")).from(users).groupBy(users.age)
+        .having(count(users.name) > 1).toSql(DialectPostgres),
+        "SELECT age,COUNT(name) AS n FROM Users GROUP BY age HAVING COUNT(name) > 1");
+    CHECK(Select().from(users).offset(5).toSql(DialectSqlite), "SELECT * FROM Users LIMIT -1 OFFSET 5");
+    CHECK(Select().from(users).where(users.age==param(SqlInt) || users.name==param(SqlString)).toSql(DialectPostgres),
+        "SELECT * FROM Users WHERE (age=$1) OR (name=$2)");
+    CHECK(Select().select((users.score+1)*(users.age%3), users.age-(-1)).from(users).toSql(DialectSqlite),
+        "SELECT (score+1)*(age%3),age-(-1) FROM Users");
+}
+
+static void testLiterals()
+{
+    CHECK(Select().from(users).where(users.name=="it's\\").toSql(DialectMysql),
+        "SELECT * FROM Users WHERE name='it''s\\\\'");
+    CHECK(Select().from(users).where(users.name=="x\\' OR 1=1 -- ").toSql(DialectMysql),
+        "SELECT * FROM Users WHERE name='x\\\\'' OR 1=1 -- '");
+    CHECK(Select().from(users).where(users.name=="it's\\").toSql(DialectSqlite),
+        "SELECT * FROM Users WHERE name='it''s\\'");
+    CHECK(Select().from(users).where(users.score==0.1).toSql(DialectMysql),
+        "SELECT * FROM Users WHERE score=0.1");
+    CHECK(Select().from(users).where(users.score==2.0 || users.score==1e300).toSql(DialectMysql),
+        "SELECT * FROM Users WHERE (score=2.0) OR (score=1e+300)");
+    CHECK(Select().select(Literal(true), Literal(DateTime::fromTime(86400*365)), Literal(Blob("\x01\xff", 2))).toSql(DialectPostgres),
+        "SELECT TRUE,'1971-01-01 00:00:00','\\x01FF'::bytea");
+    CHECK(Select().select(Literal(true), Literal(9007199254740993LL)).toSql(DialectSqlite),
+        "SELECT 1,9007199254740993");
+}
+
+static void testWrites()
+{
+    CHECK(Insert().insertInto(users).values(users.name="a", users.age=1).values(users.name="b", users.age=2)
+        .onConflict(users.name).onDuplicateKeyUpdate(users.age=values(users.age)).toSql(DialectMysql),
+        "INSERT INTO Users(name,age) VALUES ('a',1),('b',2) ON DUPLICATE KEY UPDATE age=VALUES(age)");
+    CHECK(Insert().insertInto(users).values(users.name="a", users.age=1)
+        .onConflict(users.name).onDuplicateKeyUpdate(users.age=values(users.age)).toSql(DialectSqlite),
+        "INSERT INTO Users(name,age) VALUES ('a',1) ON CONFLICT(name) DO UPDATE SET age=excluded.age");
+    // without its unique key the upsert is only valid sql in mysql.
+    Insert upsert;
+    upsert.insertInto(users).values(users.name="a", users.age=1).onDuplicateKeyUpdate(users.age=values(users.age));
+    CHECK(upsert.error(DialectMysql) ? upsert.error(DialectMysql) : "", "");
+    CHECK(upsert.error(DialectPostgres) ? upsert.error(DialectPostgres) : "", "an upsert needs its unique key, see onConflict().");
+    upsert.onConflict(users.name);
+    CHECK(upsert.error(DialectSqlite) ? upsert.error(DialectSqlite) : "", "");
+    CHECK(Update().update(users).set(users.age=users.age+1, users.score=2.5).where(users.name=="a").toSql(DialectMysql),
+        "UPDATE Users SET age=(age+1),score=2.5 WHERE name='a'");
+    CHECK(Delete().from(users).where(users.age < 3).toSql(DialectPostgres),
+        "DELETE FROM Users WHERE age < 3");
+}
+
+static void testChunks()
+{
+    vector<int> ids;
+    for(int i=0; i<5; i++) ids.push_back(i);
+    vector<string> out;
+    Select().from(users).where(users.age.in(ids) && users.score > 1).toSqlChunks(2, out, DialectMysql);
+    CHECK(std::to_string(out.size()), "3");
+    CHECK(out[0], "SELECT * FROM Users WHERE age IN (0,1) AND (score > 1)");
+    CHECK(out[2], "SELECT * FROM Users WHERE age IN (4) AND (score > 1)");
+    out.clear();
+    Select().select(count(users.name)).from(users).where(users.age.in(ids)).toSqlChunks(2, out, DialectMysql);
+    CHECK(std::to_string(out.size()), "1");
+    out.clear();
+    Select().from(users).where(users.age.in(ids)).orderBy(users.age).toSqlChunks(2, out, DialectMysql);
+    CHECK(std::to_string(out.size()), "1");
+
+    vector<long long> big(3, 5000000000ll);
+    big[1]=-1;
+    InList hits(counters.hits.notIn(big));
+    CHECK(Select().from(counters).where(hits).toSql(DialectMysql),
+        "SELECT * FROM Counters WHERE hits NOT IN (5000000000,-1,5000000000)");
+
+    // threads chunking one shared select each see every window.
+    InList in(users.age.in(ids));
+    Select shared;
+    shared.from(users).where(in);
+    vector<std::thread> threads;
+    vector<vector<string>> chunks(4);
+    for(int t=0; t<4; t++){
+        threads.emplace_back([&, t]{
+            for(int i=0; i<200; i++){
+                chunks[t].clear();
+                shared.toSqlChunks(2, chunks[t], DialectMysql);
+            }
+        });
+    }
+    for(unsigned t=0; t<threads.size(); t++) threads[t].join();
+    for(unsigned t=0; t<chunks.size(); t++){
+        CHECK(chunks[t][0] + ";" + chunks[t][1] + ";" + chunks[t][2],
+            "SELECT * FROM Users WHERE age IN (0,1);SELECT * FROM Users WHERE age IN (2,3);SELECT * FROM Users WHERE age IN (4)");
+    }
+}
+
+static void testReuse()
+{
+    Param p(SqlInt);
+    BinExp byAge(users.age > p);
+    Select s;
+    s.cacheSql().select(users.name).from(users).where(byAge).orderBy(users.age).limit(10);
+    for(int i=0; i<3; i++){
+        s.offset(i*10);
+        CHECK(s.toSql(DialectPostgres), Select().select(users.name).from(users).where(byAge).orderBy(users.age).limit(10).offset(i*10).toSql(DialectPostgres).c_str());
+    }
+    s.clear(Select::ClauseOrderBy).orderBy(users.score, OrderDesc);
+    CHECK(s.toSql(DialectPostgres),
+        "SELECT name FROM Users WHERE age > $1 ORDER BY score DESC LIMIT 10 OFFSET 20");
+    s.reset().from(users);
+    CHECK(s.toSql(DialectPostgres), "SELECT * FROM Users");
+
+    // a clause rendered alone must not inherit the state the clauses before it left.
+    vector<int> ids(2, 1);
+    InList in(users.age.in(ids));
+    Literal one(1);
+    BinExp older(BinExp::Add, users.age, one);
+    Select t;
+    t.cacheSql().from(users).where(in).orderBy(older);
+    t.toSql(DialectMysql);
+    t.clear(Select::ClauseOrderBy).orderBy(older);
+    CHECK(t.toSql(DialectMysql), "SELECT * FROM Users WHERE age IN (1,1) ORDER BY age+1 ASC");
+
+    // a select nested in a kept clause changes.
+    Select owners;
+    owners.select(orders.owner).from(orders);
+    InList buyers(users.name.in(owners));
+    Table named("named", owners);
+    Select outer;
+    outer.cacheSql().with(named).from(users).where(buyers).limit(1);
+    outer.toSql(DialectMysql);
+    outer.toSql(DialectMysql);
+    Literal ten(10);
+    BinExp big(orders.total > ten);
+    owners.where(big);
+    CHECK(outer.limit(2).toSql(DialectMysql),
+        "WITH named AS (SELECT owner FROM Orders WHERE total > 10) SELECT * FROM Users WHERE name IN (SELECT owner FROM Orders WHERE total > 10) LIMIT 2");
+
+    Delete d;
+    d.cacheSql().from(users).where(byAge);
+    CHECK(d.toSql(DialectPostgres), "DELETE FROM Users WHERE age > $1");
+    CHECK(d.where(in).toSql(DialectPostgres), "DELETE FROM Users WHERE age IN (1,1)");
+
+    // a cached statement rendered by several threads at once.
+    string expected = outer.toSql(DialectMysql);
+    vector<std::thread> threads;
+    vector<int> wrong(4);
+    for(int i=0; i<4; i++){
+        threads.emplace_back([&outer, &expected, &wrong, i](){
+            for(int k=0; k<2000; k++) wrong[i] += outer.toSql(DialectMysql) != expected;
+        });
+    }
+    for(int i=0; i<4; i++) threads[i].join();
+    CHECK(std::to_string(wrong[0]+wrong[1]+wrong[2]+wrong[3]), "0");
+}
+
+static void testTables()
+{
+    FuncCall most(max(orders.total));
+    Select total;
+    total.select(most).from(orders);
+    SubQuery top(subquery(total));
+    vector<const Table*> tables;
+    Select().from(users).orderBy(top).getTables(tables);
+    CHECK(std::to_string(tables.size()), "2");
+    tables.clear();
+    FuncCall n(count(top));
+    Select().select(n).from(users).getTables(tables);
+    CHECK(std::to_string(tables.size()), "2");
+}
+
+static void testJoins()
+{
+    BinExp owns(orders.owner == users.name);
+    Literal hundred(100);
+    BinExp big(orders.total > hundred);
+    BinExp bigOwner(owns && big);
+    Join j(users.join(orders, bigOwner));
+    CHECK(Select().select(users.name, orders.total).from(j).toSql(DialectMysql),
+        "SELECT Users.name,Orders.total FROM Users JOIN Orders ON (Orders.owner=Users.name) AND (Orders.total > 100)");
+
+    // a table joined with itself through an alias, then a chained outer join.
+    Users boss;
+    boss.alias("boss");
+    BinExp sameAge(boss.age == users.age);
+    Join self(users.join(boss, sameAge));
+    Join chain(self.leftJoin(orders, owns));
+    CHECK(Select().select(users.name, boss.name, orders.id).from(chain).toSql(DialectSqlite),
+        "SELECT Users.name,boss.name,Orders.id FROM Users JOIN Users AS boss ON boss.age=Users.age LEFT JOIN Orders ON Orders.owner=Users.name");
+    Join right(users.rightJoin(orders, owns));
+    CHECK(Select().select(orders.id).from(right).toSql(DialectPostgres),
+        "SELECT Orders.id FROM Users RIGHT JOIN Orders ON Orders.owner=Users.name");
+}
+
+static void testSubqueries()
+{
+    Literal ten(10);
+    BinExp big(orders.total > ten);
+    Select owners;
+    owners.select(orders.owner).from(orders).where(big);
+    InList buyers(users.name.in(owners));
+    CHECK(Select().select(users.name).from(users).where(buyers).toSql(DialectMysql),
+        "SELECT name FROM Users WHERE name IN (SELECT owner FROM Orders WHERE total > 10)");
+    SubQuery any(exists(owners));
+    SubQuery none(notExists(owners));
+    CHECK(Select().from(users).where(any || none).toSql(DialectSqlite),
+        "SELECT * FROM Users WHERE EXISTS (SELECT owner FROM Orders WHERE total > 10) OR NOT EXISTS (SELECT owner FROM Orders WHERE total > 10)");
+
+    // the same select as a derived table and as a cte.
+    Table rich("rich", owners);
+    Field richOwner(&rich, SqlString, "owner");
+    CHECK(Select().select(richOwner).from(rich).toSql(DialectMysql),
+        "SELECT owner FROM (SELECT owner FROM Orders WHERE total > 10) AS rich");
+    CHECK(Select().with(rich).select(richOwner).from(rich).toSql(DialectPostgres),
+        "WITH rich AS (SELECT owner FROM Orders WHERE total > 10) SELECT owner FROM rich");
+}
+
+static void testSimplify()
+{
+    setSimplifyExpressions(true);
+    CHECK(Select().from(users).where(users.age+1 > 3 && users.score*2 >= 1.0).toSql(DialectMysql),
+        "SELECT * FROM Users WHERE age > 2 AND score*2 >= 1.0");
+    CHECK(Select().select(users.age/(Literal(1.5)+1.5), users.age/(Literal(2.0f)+1)).from(users).orderBy(Literal(4)+6).toSql(DialectSqlite),
+        "SELECT age/3.0,age/3.0 FROM Users ORDER BY 4+6 ASC");
+
+    // float literals print the same folded or not, and folding never drops a placeholder.
+    Literal tenth(0.1f);
+    BinExp aboveTenth(users.score > tenth);
+    string simplified=Select().from(users).where(aboveTenth).toSql(DialectMysql);
+    setSimplifyExpressions(false);
+    CHECK(simplified, Select().from(users).where(aboveTenth).toSql(DialectMysql).c_str());
+    setSimplifyExpressions(true);
+    CHECK(Select().from(users).where(users.score > Literal(0.1f)*3).toSql(DialectMysql),
+        "SELECT * FROM Users WHERE score > 0.30000000000000004");
+    Param p(SqlInt);
+    BinExp older(users.age > p);
+    Literal no(false), yes(true);
+    CHECK(Select().from(users).where(older && older).toSql(DialectPostgres),
+        "SELECT * FROM Users WHERE age > $1 AND age > $2");
+    CHECK(Select().from(users).where((older && no) || (yes || older)).toSql(DialectPostgres),
+        "SELECT * FROM Users WHERE age > $1 AND FALSE OR TRUE OR age > $2");
+    setSimplifyExpressions(false);
+}
+
+static void testTyped()
+{
+    CHECK(Select().select(orders.id).from(orders).where(orders.total > 10 && orders.owner.like("b%")).toSql(DialectMysql),
+        "SELECT id FROM Orders WHERE (total > 10) AND (owner LIKE 'b%')");
+    CHECK(Update().update(orders).set(orders.total = orders.total*2).where(orders.id == 3).toSql(DialectMysql),
+        "UPDATE Orders SET total=(total*2) WHERE id=3");
+    CHECK(Select().select(counters.bytes).from(counters).where(counters.hits > 5000000000LL && counters.port == 8080u).toSql(DialectMysql),
+        "SELECT bytes FROM Counters WHERE (hits > 5000000000) AND (port=8080)");
+    CHECK(Update().update(counters).set(counters.bytes = counters.bytes + 4000000000u).where(counters.hits == counters.port).toSql(DialectSqlite),
+        "UPDATE Counters SET bytes=(bytes+4000000000) WHERE hits=port");
+}
+
+int main()
+{
+    testSelect();
+    testLiterals();
+    testWrites();
+    testChunks();
+    testReuse();
+    testTables();
+    testJoins();
+    testSubqueries();
+    testSimplify();
+    testTyped();
+    if (failed) printf("%d failed\n", failed);
+    return failed ? 1 : 0;
+}
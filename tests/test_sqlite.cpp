@@ -0,0 +1,733 @@
+// statements run on an in memory sqlite database through the execution layer.
+
+#include "tableDef.h"
+#include "SqlTransaction.h"
+#include "SqlCache.h"
+#include "SqlExplain.h"
+#include "SqlRecorder.h"
+#include "SqlSnapshot.h"
+#include "SqlGuard.h"
+#include "SqlShard.h"
+#include "SqlReplica.h"
+#include <thread>
+#include <stdio.h>
+
+using namespace sqlgen;
+using namespace dao;
+
+static Users users;
+static int failed;
+
+#define CHECK(cond) do{ if (!(cond)) { failed++; printf("line %d: %s\n", __LINE__, #cond); } }while(0)
+
+static int countRows()
+{
+    int n = -1;
+    query(Select().select(count(users.name)).from(users), [&](int c){ n = c; });
+    return n;
+}
+
+static void testRoundTrip()
+{
+    // string literals point to the rows, they must outlive the insert.
+    vector<Users::Row> rows(5);
+    Insert ins;
+    ins.insertInto(users);
+    for(int i=0; i<5; i++){
+        Users::Row& row = rows[i];
+        row.name = "user" + std::to_string(i);
+        row.age = 20+i;
+        row.addr = i%2 ? "it's" : "";
+        row.score = i*10;
+        row.tag = "t";
+        ins.values(UnpackRowValues_Users(row, users));
+    }
+    CHECK(execute(ins));
+    CHECK(countRows()==5);
+
+    query(Select().from(users).where(users.age >= 22).orderBy(users.age, OrderDesc), [](const vector<Users::Row>& rows){
+        CHECK(rows.size()==3);
+        CHECK(rows[0].name=="user4" && rows[0].score==40 && rows[0].addr=="");
+        CHECK(rows[2].name=="user2" && rows[2].age==22);
+    });
+    query(Select().select(users.addr).from(users).where(users.name=="user1"), [](const string& addr){
+        CHECK(addr=="it's");
+    });
+    query(Select().select(sum(users.score), max(users.age)).from(users), [](int total, int oldest){
+        CHECK(total==100 && oldest==24);
+    });
+
+    int n = 0;
+    queryEach(Select().select(users.name, users.age).from(users), [&](const string& name, int age){
+        CHECK(name=="user"+std::to_string(age-20));
+        n++;
+    });
+    CHECK(n==5);
+
+    CHECK(execute(Update().update(users).set(users.score=users.score+1).where(users.age < 22)));
+    query(Select().select(users.score).from(users).where(users.name=="user1"), [](int s){ CHECK(s==11); });
+    CHECK(execute(Delete().from(users).where(users.age > 23)));
+    CHECK(countRows()==4);
+
+    // an upsert without its unique key isn't sent.
+    Insert upsert;
+    upsert.insertInto(users).values(users.name="user0", users.age=1).onDuplicateKeyUpdate(users.age=values(users.age));
+    CHECK(!execute(upsert));
+    CHECK(countRows()==4);
+}
+
+static void testReals()
+{
+    // user1 is 21, an integral double must not turn `/` into an integer division.
+    query(Select().select(users.age/2.0).from(users).where(users.name=="user1"), [](double half){
+        CHECK(half==10.5);
+    });
+    FuncCall mean(avg(users.age));
+    CHECK(mean.getSqlType()==SqlDouble);
+    query(Select().select(mean).from(users), [](double a){ CHECK(a==21.5); });
+}
+
+static void testUnsigned()
+{
+    SqlResultReader* r = getConnection()->execute("select 4000000000, 9223372036854775807, -1");
+    CHECK(r && SqlType<unsigned>::fromSql(*r)==4000000000u);
+    CHECK(r && SqlType<unsigned long long>::fromSql(*r)==9223372036854775807ull);
+    CHECK(r && SqlType<unsigned long long>::fromSql(*r)==~0ull);
+    delete r;
+}
+
+static double firstValue( const Select& s )
+{
+    double v = -1;
+    query(s, [&](double d){ v = d; });
+    return v;
+}
+
+// folded constants must keep the meaning of the plain sql.
+static void testSimplify()
+{
+    Literal f(2.0f), d(1.5), two(2), one(1);
+    BinExp floats(BinExp::Add, f, one), doubles(BinExp::Add, d, d), ints(BinExp::Add, two, one);
+    BinExp byFloat(users.age/floats), byDouble(users.age/doubles), byInt(users.age/ints);
+    Literal name("user1");
+    BinExp user1(BinExp::Equ, users.name, name);
+    const Exp* exps[] = { &byFloat, &byDouble, &byInt };
+    for(int i=0; i<3; i++){
+        Select s;
+        s.select(*exps[i]).from(users).where(user1);
+        double plain = firstValue(s);
+        setSimplifyExpressions(true);
+        CHECK(firstValue(s)==plain);
+        setSimplifyExpressions(false);
+    }
+    // `ORDER BY 4+6` is a constant, `ORDER BY 10` would be a column number.
+    Literal four(4), six(6);
+    BinExp ten(BinExp::Add, four, six);
+    Select byConst;
+    byConst.select(users.age).from(users).orderBy(ten);
+    setSimplifyExpressions(true);
+    CHECK(firstValue(byConst) >= 20);
+    setSimplifyExpressions(false);
+}
+
+// fails its nth statement.
+struct FailingConnection : SqlConnection
+{
+    SqlConnection&  c;
+    int             n;
+    bool            failed;
+
+    FailingConnection(SqlConnection& c_, int n_):c(c_),n(n_),failed(false){}
+    SqlDialect          dialect()const{ return c.dialect(); }
+    SqlResultReader*    execute(const char* sql){ failed = --n==0; return failed ? 0 : c.execute(sql); }
+    const char*         error(){ return failed ? "failed" : c.error(); }
+};
+
+static void testChunks()
+{
+    vector<string> names;
+    for(int i=0; i<5; i++) names.push_back("user" + std::to_string(i));
+    InList in(users.name.in(names));
+    FuncCall n(count(users.name));
+    setInListChunkSize(2);
+    query(Select().select(n).from(users).where(in), [](int c){ CHECK(c==4); });
+    int rows = 0;
+    query(Select().select(users.name).from(users).where(in).limit(3), [&](const vector<string>& r){ rows = static_cast<int>(r.size()); });
+    CHECK(rows==3);
+
+    // a failed chunk fails the whole select.
+    FailingConnection second(*getConnection(), 2);
+    CHECK(!executeSelect(second, Select().select(users.name).from(users).where(in)));
+    CHECK(*second.error());
+    setInListChunkSize(1000);
+}
+
+// answers every statement with the same rows of one column.
+struct CannedConnection : SqlConnection
+{
+    SqlDialect          d;
+    vector<string>      lines;
+    string              last;
+
+    explicit CannedConnection(SqlDialect d_):d(d_){}
+    SqlDialect          dialect()const{ return d; }
+    const char*         error(){ return ""; }
+    SqlResultReader*    execute(const char* sql)
+    {
+        last = sql;
+        StoredResult* r = new StoredResult;
+        r->nfields = 1;
+        for(unsigned i=0; i<lines.size(); i++, r->nrows++) r->addField(lines[i].c_str(), lines[i].size());
+        return r;
+    }
+};
+
+static void testExplain()
+{
+    Literal twenty(20);
+    BinExp byAge(users.age > twenty);
+    QueryPlan p = explain(Select().from(users).where(byAge));
+    CHECK(p.ok && p.fullScan && p.steps.size()==1 && p.steps[0].table=="Users");
+    CHECK(execute("create index idx_age on Users(age)"));
+    p = explain(Select().from(users).where(byAge).orderBy(users.name));
+    CHECK(p.ok && !p.fullScan && p.fileSort && p.steps[0].key=="idx_age");
+    CHECK(execute("drop index idx_age"));
+
+    CannedConnection pg(DialectPostgres);
+    pg.lines.push_back("Sort  (cost=1.10..1.11 rows=3 width=36)");
+    pg.lines.push_back("  Sort Key: name");
+    pg.lines.push_back("  ->  Seq Scan on users  (cost=0.00..1.07 rows=3 width=36)");
+    pg.lines.push_back("        Filter: (age > 20)");
+    pg.lines.push_back("  ->  Index Scan using idx_age on users u  (cost=0.15..8.17 rows=1 width=36)");
+    p = explain(pg, Select().from(users).where(users.age > 20).offset(1));
+    CHECK(pg.last=="EXPLAIN SELECT * FROM Users WHERE age > 20 OFFSET 1");
+    CHECK(p.ok && p.fullScan && p.fileSort && !p.tempTable && p.steps.size()==3);
+    CHECK(p.steps[1].access=="Seq Scan" && p.steps[1].table=="users" && p.steps[1].rows==3);
+    CHECK(p.steps[2].access=="Index Scan" && p.steps[2].key=="idx_age" && p.steps[2].table=="users");
+
+    // a backslash only escapes in mysql strings.
+    CHECK(queryShape("select * from t where a='C:\\' and b=5", DialectSqlite)=="select * from t where a=? and b=?");
+    CHECK(queryShape("select * from t where a='it\\'s' and b=5", DialectMysql)=="select * from t where a=? and b=?");
+    CHECK(queryShape("select * from t where a='it''s' and b in (1, 2)", DialectPostgres)=="select * from t where a=? and b in (?)");
+}
+
+static void testSubqueries()
+{
+    Literal older(22);
+    BinExp isOld(users.age >= older);
+    Select old;
+    old.select(users.name, users.age).from(users).where(isOld);
+    Table oldUsers("old", old);
+    Field oldAge(&oldUsers, SqlInt, "age");
+    int n = -1;
+    FuncCall counted(count(oldAge));
+    query(Select().select(counted).from(oldUsers), [&](int c){ n = c; });
+    CHECK(n==2);
+    n = -1;
+    query(Select().with(oldUsers).select(counted).from(oldUsers), [&](int c){ n = c; });
+    CHECK(n==2);
+
+    Select oldNames;
+    oldNames.select(users.name).from(users).where(isOld);
+    InList young(users.name.notIn(oldNames));
+    n = -1;
+    query(Select().select(count(users.name)).from(users).where(young), [&](int c){ n = c; });
+    CHECK(n==2);
+
+    FuncCall oldest(max(users.age));
+    Select top;
+    top.select(oldest).from(users);
+    SubQuery topAge(subquery(top));
+    BinExp isTop(users.age == topAge);
+    query(Select().select(users.name).from(users).where(isTop), [](const string& name){ CHECK(name=="user3"); });
+}
+
+static void testJoins()
+{
+    // each user with the one a year older, the oldest has none.
+    Users next;
+    next.alias("next");
+    Literal year(1);
+    BinExp older(users.age + year);
+    BinExp isNext(next.age == older);
+    Join inner(users.join(next, isNext));
+    Join outer(users.leftJoin(next, isNext));
+    FuncCall n(count(users.name)), matched(count(next.name));
+    int rows = -1, found = -1;
+    query(Select().select(n, matched).from(inner), [&](int r, int f){ rows = r; found = f; });
+    CHECK(rows==3 && found==3);
+    query(Select().select(n, matched).from(outer), [&](int r, int f){ rows = r; found = f; });
+    CHECK(rows==4 && found==3);
+
+    // the oldest has no match, its columns of next are NULL.
+    typedef std::tuple<string, Nullable<string>, Nullable<int>, int> Pair;
+    query(Select().select(users.name, next.name, next.age, next.age).from(outer).orderBy(users.age), [](const vector<Pair>& pairs){
+        CHECK(pairs.size()==4);
+        CHECK(*std::get<1>(pairs[0])=="user1" && *std::get<2>(pairs[0])==21);
+        CHECK(std::get<0>(pairs[3])=="user3" && !std::get<1>(pairs[3]) && !std::get<2>(pairs[3]) && std::get<3>(pairs[3])==0);
+    });
+#ifdef SQLGEN_OPTIONAL
+    query(Select().select(next.name).from(outer).orderBy(users.age), [](const vector<std::optional<string>>& names){
+        CHECK(names.size()==4 && *names[0]=="user1" && !names[3]);
+    });
+#endif
+}
+
+static void testNulls()
+{
+    CHECK(execute("insert into Users(name) values('nobody')"));
+    query(Select().select(users.age).from(users).orderBy(users.name), [](const NullableColumn<int>& ages){
+        CHECK(ages.size()==5 && ages.hasNulls() && ages.isNull(0) && !ages.isNull(1));
+    });
+    CHECK(execute(Delete().from(users).where(users.name=="nobody")));
+
+    // blobs keep their zeros whichever way they're read.
+    CHECK(execute("insert into Users(name, tag) values('blob', x'610062')"));
+    CHECK(execute("insert into Users(name) values('noblob')"));
+    query(Select().select(users.tag).from(users).where(users.name=="blob"), [](const Nullable<Blob>& b){
+        CHECK(b && b->data==string("a\0b", 3));
+    });
+    query(Select().select(users.tag).from(users).where(users.name=="noblob"), [](const Nullable<Blob>& b){ CHECK(!b); });
+    Literal blob("blob"), noblob("noblob");
+    BinExp isBlob(users.name==blob), isNoBlob(users.name==noblob);
+    query(Select().select(users.tag).from(users).where(isBlob || isNoBlob).orderBy(users.name), [](const NullableColumn<Blob>& tags){
+        CHECK(tags.size()==2 && tags.values[0].data.size()==3 && tags.isNull(1));
+    });
+    CHECK(execute("delete from Users where name like '%blob'"));
+}
+
+static void testTransaction()
+{
+    {
+        Transaction tx;
+        CHECK(execute(Delete().from(users)));
+        CHECK(countRows()==0);
+    }
+    CHECK(countRows()==4);
+    {
+        Transaction tx;
+        CHECK(execute(Insert().insertInto(users).values(users.name="x", users.age=1)));
+        CHECK(tx.commit());
+    }
+    CHECK(countRows()==5);
+
+    // savepoints: the inner rollback only undoes its own insert.
+    {
+        Transaction tx;
+        CHECK(execute("insert into Users(name) values('sp0')"));
+        {
+            Transaction inner;
+            CHECK(inner.depth==1 && getConnection()->txDepth==2);
+            CHECK(execute("insert into Users(name) values('sp1')"));
+        }
+        {
+            Transaction inner;
+            CHECK(execute("insert into Users(name) values('sp2')"));
+            CHECK(inner.commit());
+        }
+        CHECK(countRows()==7);
+        CHECK(tx.commit());
+    }
+    CHECK(countRows()==7 && getConnection()->txDepth==0);
+    CHECK(execute("delete from Users where name like 'sp%'"));
+
+    // a failed BEGIN opens nothing.
+    {
+        FailingConnection c(*getConnection(), 1);
+        Transaction tx(c);
+        CHECK(!tx.began && c.txDepth==0 && !tx.commit());
+    }
+
+    // a failed COMMIT keeps the transaction, which is rolled back when destroyed.
+    {
+        FailingConnection c(*getConnection(), 3);
+        {
+            Transaction tx(c);
+            CHECK(execute(c, "insert into Users(name) values('lost')"));
+            CHECK(!tx.commit() && !tx.done && c.txDepth==1);
+        }
+        CHECK(c.txDepth==0);
+    }
+    CHECK(countRows()==5);
+}
+
+struct CancelCounter : SqlConnection
+{
+    SqlConnection&  c;
+    int             cancels;
+
+    explicit CancelCounter(SqlConnection& c_):c(c_),cancels(0){}
+    SqlDialect          dialect()const{ return c.dialect(); }
+    SqlResultReader*    execute(const char* sql){ return c.execute(sql); }
+    const char*         error(){ return c.error(); }
+    void                cancel(){ cancels++; }
+};
+
+static void testRecorder()
+{
+    CancelCounter target(*getConnection());
+    {
+        RecordingConnection rec(target, "test_sqlite.rec");
+        CHECK(rec.ok());
+        rec.cancel();
+        CHECK(target.cancels==1);
+
+        // a transaction opened on either side is seen through the other.
+        Transaction tx(target);
+        {
+            Transaction inner(rec);
+            CHECK(inner.began && inner.depth==1 && target.txDepth==2 && rec.transactionDepth()==2);
+            CHECK(execute(rec, "insert into Users(name) values('rec')"));
+        }
+        CHECK(target.txDepth==1);
+    }
+    CHECK(countRows()==5);
+
+    vector<RecordedStatement> log;
+    CHECK(loadRecording("test_sqlite.rec", log) && log.size()==4);
+    CHECK(log[0].sql=="SAVEPOINT sp1" && !log[0].failed && log[1].rows==-1);
+    remove("test_sqlite.rec");
+
+    // replayed in the order the statements started, not the one they completed in.
+    {
+        RecordingConnection rec(target, "test_sqlite.rec");
+        CHECK(execute(rec, "insert into Users(name) values('replayed')"));
+        CHECK(countRows()==6);
+        delete rec.execute("select name from Users where name='replayed'");
+        CHECK(execute(rec, "delete from Users where name='replayed'"));
+    }
+    log.clear();
+    CHECK(loadRecording("test_sqlite.rec", log) && log.size()==3 && log[1].rows==1);
+    std::swap(log[0], log[2]);
+    vector<SqlConnection*> workers(1, getConnection());
+    ReplayReport rep = replay(log, workers, 0);
+    CHECK(rep.statements==3 && rep.failed==0 && rep.rowMismatches==0);
+    CHECK(countRows()==5);
+    remove("test_sqlite.rec");
+}
+
+static void testSnapshot()
+{
+    SqlResultReader* r = getConnection()->execute("select name, age, x'610062' from Users where age >= 20 order by age");
+    CHECK(r && saveSnapshot(*r, "test_sqlite.snap"));
+    delete r;
+    FILE* tmp = fopen("test_sqlite.snap.tmp", "rb");
+    CHECK(!tmp);
+    if (tmp) fclose(tmp);
+
+    Snapshot snap;
+    CHECK(snap.open("test_sqlite.snap") && snap.nrows==4 && snap.nfields==3);
+    CHECK(snap.get<string>(0, 0)=="user0" && snap.get<int>(3, 1)==23);
+    CHECK(snap.get<Blob>(2, 2).data==string("a\0b", 3));
+    snap.close();
+
+    // a field pointing past the arena, then a truncated file.
+    FILE* f = fopen("test_sqlite.snap", "r+b");
+    SnapshotField bad = {1u<<20, 5, 0};
+    fseek(f, sizeof(SnapshotHeader), SEEK_SET);
+    fwrite(&bad, sizeof(bad), 1, f);
+    fclose(f);
+    CHECK(!snap.open("test_sqlite.snap"));
+    f = fopen("test_sqlite.snap", "wb");
+    SnapshotHeader h = {{'S','Q','L','S','N','A','P','1'}, 4, 2, sizeof(SnapshotHeader)+8*sizeof(SnapshotField)};
+    fwrite(&h, sizeof(h), 1, f);
+    fclose(f);
+    CHECK(!snap.open("test_sqlite.snap"));
+    remove("test_sqlite.snap");
+}
+
+// runs until cancelled, its cancel() runs a guarded statement the way mysql's KILL QUERY
+// runs on a second connection.
+struct HangingConnection : SqlConnection
+{
+    GuardedConnection&      killer;
+    std::mutex              m;
+    std::condition_variable cv;
+    bool                    cancelled, killed;
+
+    explicit HangingConnection(GuardedConnection& k):killer(k),cancelled(false),killed(false){}
+    SqlDialect          dialect()const{ return DialectSqlite; }
+    SqlResultReader*    execute(const char*)
+    {
+        std::unique_lock<std::mutex> g(m);
+        cv.wait_for(g, std::chrono::seconds(5), [this]{ return cancelled; });
+        return 0;
+    }
+    const char*         error(){ return cancelled ? "interrupted" : ""; }
+    void                cancel()
+    {
+        killed = sqlgen::execute(killer, "select 1");
+        std::lock_guard<std::mutex> g(m);
+        cancelled = true;
+        cv.notify_all();
+    }
+};
+
+static void testGuard()
+{
+    GuardedConnection killer(*getConnection(), 1000);
+    HangingConnection hang(killer);
+    GuardedConnection guarded(hang, 20);
+    CHECK(!guarded.execute("select 1"));
+    CHECK(hang.killed && guarded.timeouts==1 && string(guarded.error())=="statement timed out");
+
+    // a statement done in time isn't cancelled.
+    GuardedConnection fast(*getConnection(), 1000);
+    CHECK(execute(fast, "select 1") && fast.timeouts==0);
+
+    // one in flight, one queued: the next is rejected at once, the queued one once it waited too long.
+    auto queuedOn = [](InFlightLimiter& l){
+        for(;;){
+            {
+                std::lock_guard<std::mutex> g(l.lock);
+                if (l.queued) return;
+            }
+            std::this_thread::yield();
+        }
+    };
+    InFlightLimiter limiter(1, 1, 50);
+    GuardedConnection limited(*getConnection(), 0, &limiter);
+    CHECK(limiter.acquire());
+    bool waited = true;
+    std::thread waiter([&]{ waited = limiter.acquire(); });
+    queuedOn(limiter);
+    CHECK(!limited.execute("select 1") && limited.rejections==1 && string(limited.error())=="rejected: too many statements in flight");
+    waiter.join();
+    CHECK(!waited && limiter.queued==0 && limiter.peakQueued==1);
+    CHECK(limiter.admitted==1 && limiter.rejected==2 && limiter.waitedUs==0);
+    limiter.release();
+    CHECK(execute(limited, "select 1") && limiter.admitted==2 && limiter.inFlight==0);
+
+    // a release admits the queued statement.
+    InFlightLimiter patient(1, 1, 5000);
+    CHECK(patient.acquire());
+    std::thread admitted([&]{ waited = patient.acquire(); });
+    queuedOn(patient);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    patient.release();
+    admitted.join();
+    CHECK(waited && patient.admitted==2 && patient.rejected==0 && patient.waitedUs>0);
+    patient.release();
+    CHECK(patient.stats()=="in flight 0/1, queued 0/1(peak 1), admitted 2, rejected 0, avg wait " + std::to_string(patient.waitedUs/2) + "us");
+}
+
+static void testShards()
+{
+    sqlite3* dbs[2];
+    std::unique_ptr<SqliteConnection> cons[2];
+    vector<SqlConnection*> shards;
+    for(int i=0; i<2; i++){
+        sqlite3_open(":memory:", &dbs[i]);
+        cons[i].reset(new SqliteConnection(dbs[i]));
+        CHECK(execute(*cons[i], "create table Users(name varchar(255), age int, addr varchar(255), score int, tag varchar(255))"));
+        shards.push_back(cons[i].get());
+    }
+    ShardRouter router(shards, users.name);
+    CHECK(router.execute(Insert().insertInto(users).values(users.name="10", users.age=5).values(users.name="9", users.age=300)
+        .values(users.name="a", users.age=-40).values(users.name="b2", users.age=7)));
+
+    // names that look like numbers still sort as text, like on one database.
+    query(router, Select().select(users.name).from(users).orderBy(users.name), [](const vector<string>& names){
+        CHECK(names.size()==4 && names[0]=="10" && names[1]=="9" && names[2]=="a" && names[3]=="b2");
+    });
+    query(router, Select().select(users.name).from(users).orderBy(users.age, OrderDesc).limit(2).offset(1), [](const vector<string>& names){
+        CHECK(names.size()==2 && names[0]=="b2" && names[1]=="10");
+    });
+
+    // an aggregate over several shards is refused, not answered per shard.
+    FuncCall n(count(users.name));
+    CHECK(!router.select(Select().select(n).from(users)) && string(router.error())=="an aggregated, grouped or distinct select must be pinned to one shard");
+    CHECK(!router.select(Select().select(users.age).from(users).groupBy(users.age)));
+    int counted = -1;
+    query(router, Select().select(n).from(users).where(users.name=="9"), [&](int c){ counted = c; });
+    CHECK(counted==1 && !*router.error());
+    for(int i=0; i<2; i++){
+        cons[i].reset();
+        sqlite3_close(dbs[i]);
+    }
+}
+
+// a primary whose writes take writeMs.
+struct SlowWrites : CannedConnection
+{
+    int writeMs;
+
+    SlowWrites(SqlDialect d_, int writeMs_):CannedConnection(d_),writeMs(writeMs_){}
+    SqlResultReader* execute(const char* sql)
+    {
+        if (!isReadOnly(sql, d)) std::this_thread::sleep_for(std::chrono::milliseconds(writeMs));
+        return CannedConnection::execute(sql);
+    }
+};
+
+static void testReplicas()
+{
+    CHECK(isReadOnly("select * from Users where name='for update'", DialectSqlite));
+    CHECK(isReadOnly("select * from Users where name='it\\'s for update'", DialectMysql));
+    CHECK(!isReadOnly("select * from Users where age > 3 for update", DialectPostgres));
+    CHECK(!isReadOnly("SELECT * FROM Users FOR NO KEY UPDATE", DialectPostgres));
+    CHECK(!isReadOnly("select * from Users lock in share mode", DialectMysql));
+    CHECK(!isReadOnly("with a as (select 1) select * from a for share", DialectPostgres));
+    CHECK(isReadOnly("select before, format from Users", DialectMysql));
+
+    SlowWrites primary(DialectMysql, 100);
+    CannedConnection replica(DialectMysql);
+    vector<SqlConnection*> replicas(1, &replica);
+    ReplicaPool pool(replicas, 50);
+    ReplicaSession session(pool, primary);
+    delete session.execute("select 1");
+    CHECK(replica.last=="select 1");
+    delete session.execute("select 2 for update");
+    CHECK(primary.last=="select 2 for update");
+
+    // the write outlasts maxLag, the read right after it is still pinned.
+    delete session.execute("update Users set age=1");
+    delete session.execute("select 3");
+    CHECK(primary.last=="select 3" && replica.last=="select 1");
+
+    // a session's error is its own, not the one another session left on the shared replica.
+    sqlite3 *rdb, *adb, *bdb;
+    sqlite3_open(":memory:", &rdb);
+    sqlite3_open(":memory:", &adb);
+    sqlite3_open(":memory:", &bdb);
+    SqliteConnection shared(rdb), ownA(adb), ownB(bdb);
+    vector<SqlConnection*> one(1, &shared);
+    ReplicaPool sharedPool(one, 0);
+    ReplicaSession a(sharedPool, ownA), b(sharedPool, ownB);
+    delete a.execute("select 1");
+    CHECK(!b.execute("select * from missing") && *b.error());
+    CHECK(!*a.error());
+    std::thread other([&]{
+        for(int i=0; i<200; i++) delete b.execute(i%2 ? "select 1" : "select * from missing");
+    });
+    for(int i=0; i<200; i++) delete a.execute("select 2");
+    other.join();
+    CHECK(!*a.error() && sharedPool.fallbacks==101);
+    sqlite3_close(rdb);
+    sqlite3_close(adb);
+    sqlite3_close(bdb);
+}
+
+static void testGroupCommit()
+{
+    {
+        GroupCommit g(*getConnection(), 2, 60000);
+        for(int i=0; i<3; i++) CHECK(g.add("insert into Users(name) values('g" + std::to_string(i) + "')"));
+        CHECK(g.commits==1 && g.pending==1);
+        CHECK(g.flush() && g.commits==2);
+    }
+    CHECK(countRows()==8);
+    CHECK(execute("delete from Users where name like 'g%'"));
+
+    // a failed BEGIN doesn't run the statement, a failed COMMIT isn't counted.
+    FailingConnection begin(*getConnection(), 1);
+    GroupCommit g(begin, 1, 60000);
+    CHECK(!g.add("insert into Users(name) values('g')") && !g.tx);
+    FailingConnection commit(*getConnection(), 3);
+    GroupCommit g2(commit, 1, 60000);
+    CHECK(!g2.add("insert into Users(name) values('g')") && g2.commits==0);
+    CHECK(countRows()==5);
+}
+
+static void testCache()
+{
+    ResultCache cache(1<<20, 60000);
+    setResultCache(&cache);
+    CHECK(countRows()==5);
+    CHECK(countRows()==5);
+    CHECK(cache.hits==1);
+    CHECK(execute(Delete().from(users).where(users.name=="x")));
+    CHECK(countRows()==4);
+
+    // a transaction's reads could be rolled back.
+    {
+        Transaction tx;
+        CHECK(execute("insert into Users(name) values('phantom')"));
+        CHECK(countRows()==5);
+    }
+    CHECK(countRows()==4);
+
+    // the same sql on another database.
+    sqlite3* db;
+    sqlite3_open(":memory:", &db);
+    SqliteConnection other(db);
+    CHECK(execute(other, "create table Users(name varchar(255), age int, addr varchar(255), score int, tag varchar(255))"));
+    int n = -1;
+    query(other, Select().select(count(users.name)).from(users), [&](int c){ n = c; });
+    CHECK(n==0);
+    sqlite3_close(db);
+
+    // a select that started before an invalidation doesn't store its rows.
+    vector<const Table*> tables(1, &users);
+    Select all;
+    all.from(users);
+    unsigned gen = cache.generation(tables);
+    cache.invalidate(users);
+    cache.put(*getConnection(), all.toSql(), std::make_shared<StoredResult>(), tables, gen);
+    CHECK(!cache.find(*getConnection(), all.toSql()));
+
+    // another connection reading while a transaction writes caches the old rows, the commit drops them.
+    remove("test_sqlite.db");
+    sqlite3 *da, *db2;
+    sqlite3_open("test_sqlite.db", &da);
+    sqlite3_open("test_sqlite.db", &db2);
+    SqliteConnection a(da), b(db2);
+    CHECK(execute(a, "create table Users(name varchar(255), age int, addr varchar(255), score int, tag varchar(255))"));
+    auto countOn = [](SqlConnection& c){
+        int n = -1;
+        query(c, Select().select(count(users.name)).from(users), [&](int k){ n = k; });
+        return n;
+    };
+    {
+        Transaction tx(a);
+        Insert ins;
+        CHECK(execute(a, ins.insertInto(users).values(users.name="new")));
+        CHECK(countOn(b)==0);
+        CHECK(tx.commit() && a.txWrites.empty());
+    }
+    CHECK(countOn(b)==1);
+    {
+        GroupCommit batch(a, 10, 60000);
+        Insert ins;
+        CHECK(batch.add(ins.insertInto(users).values(users.name="batched")));
+        CHECK(countOn(b)==1);
+    }
+    CHECK(countOn(b)==2);
+    sqlite3_close(da);
+    sqlite3_close(db2);
+    remove("test_sqlite.db");
+    setResultCache(0);
+}
+
+int main()
+{
+    sqlite3* db;
+    sqlite3_open(":memory:", &db);
+    SqliteConnection con(db);
+    setConnection(&con);
+    setDefaultDialect(DialectSqlite);
+    CHECK(execute("create table Users(name varchar(255), age int, addr varchar(255), score int, tag varchar(255))"));
+
+    testRoundTrip();
+    testReals();
+    testUnsigned();
+    testSimplify();
+    testChunks();
+    testExplain();
+    testSubqueries();
+    testJoins();
+    testNulls();
+    testTransaction();
+    testGroupCommit();
+    testRecorder();
+    testSnapshot();
+    testGuard();
+    testShards();
+    testReplicas();
+    testCache();
+
+    setConnection(0);
+    sqlite3_close(db);
+    if (failed) printf("%d failed\n", failed);
+    return failed ? 1 : 0;
+}